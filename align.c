@@ -6,6 +6,7 @@
 #include <limits.h>
 #include <ctype.h>
 #include <math.h>
+#include <getopt.h>
 #include "align.h"
 #include "kvec.h"
 #include "utils.h"
@@ -94,9 +95,15 @@ static void update_a(mem_opt_t *opt, const mem_opt_t *opt0) {
 	}
 }
 
+// Long options, returning characters absent from the short option string
+static const struct option alignLongOptions[] = {
+	{ "report-only", no_argument, 0, 'q' },
+	{ 0, 0, 0, 0 }
+};
+
 int command_align(int argc, char *argv[]) {
 	mem_opt_t *opt, opt0;
-	int fd, fd2, i, c, ignore_alt = 0, no_mt_io = 0;
+	int fd, fd2, i, c, ignore_alt = 0, no_mt_io = 0, mapFlags = 0;
 	int fixed_chunk_size = -1;
 	gzFile fp, fp2 = 0;
 	char *p, *rg_line = 0, *hdr_line = 0;
@@ -117,7 +124,7 @@ int command_align(int argc, char *argv[]) {
 	memset(&opt0, 0, sizeof(mem_opt_t));
     proxyAddress = NULL;
 
-	while ((c = getopt(argc, argv, "1epabgnMCSVYJjf:F:u:k:o:c:v:s:r:t:R:A:B:O:E:U:w:L:d:T:Q:D:m:I:N:W:x:G:h:y:K:X:H:P:")) >= 0) {
+	while ((c = getopt_long(argc, argv, "1epabgnMCSVYJjf:F:u:k:o:c:v:s:r:t:R:A:B:O:E:U:w:L:d:T:Q:D:m:I:N:W:x:G:h:y:K:X:H:P:z:i:", alignLongOptions, 0)) >= 0) {
 		if (c == 'k') opt->min_seed_len = atoi(optarg), opt0.min_seed_len = 1;
 		else if (c == 'u') opt->outputType = atoi(optarg);
 		else if (c == 'f') opt->min_orf_len = atoi(optarg);
@@ -125,12 +132,14 @@ int command_align(int argc, char *argv[]) {
 		else if (c == 'o') prefixName = optarg;
 		else if (c == '1') no_mt_io = 1;
 		else if (c == 'x') mode = optarg;
+		else if (c == 'z') mapFlags = atoi(optarg);
 		else if (c == 'w') opt->w = atoi(optarg), opt0.w = 1;
 		else if (c == 'A') opt->a = atoi(optarg), opt0.a = 1;
 		else if (c == 'B') opt->b = atoi(optarg), opt0.b = 1;
 		else if (c == 'T') opt->T = atoi(optarg), opt0.T = 1;
 		else if (c == 'U') opt->pen_unpaired = atoi(optarg), opt0.pen_unpaired = 1;
 		else if (c == 't') opt->n_threads = atoi(optarg), opt->n_threads = opt->n_threads > 1? opt->n_threads : 1;
+		else if (c == 'i') opt->seed_batch = atoi(optarg), opt->seed_batch = opt->seed_batch > 1? opt->seed_batch : 1;
 		//else if (c == 'P') opt->flag |= MEM_F_NOPAIRING;
 		else if (c == 'a') opt->flag |= MEM_F_ALL;
 		//else if (c == 'p') opt->flag |= MEM_F_PE | MEM_F_SMARTPE;
@@ -145,6 +154,7 @@ int command_align(int argc, char *argv[]) {
 		else if (c == 'n') opt->proteinFlag |= ALIGN_FLAG_KEEP_PRO;
 		else if (c == 'J') opt->proteinFlag &= ~ALIGN_FLAG_ADJUST_ORF;
         else if (c == 'p') opt->proteinFlag |= ALIGN_FLAG_MANUAL_PRO;
+		else if (c == 'q') opt->proteinFlag |= ALIGN_FLAG_REPORT_ONLY;
 		else if (c == 'c') opt->max_occ = atoi(optarg), opt0.max_occ = 1;
 		else if (c == 'd') opt->zdrop = atoi(optarg), opt0.zdrop = 1;
 		else if (c == 'v') bwa_verbose = atoi(optarg);
@@ -238,6 +248,15 @@ int command_align(int argc, char *argv[]) {
 		return 1;
 	}
 
+	// Report-only mode writes the UniProt report alone, with single-end mapping qualities
+	if ((opt->proteinFlag & ALIGN_FLAG_REPORT_ONLY) && (prefixName == NULL || optind + 2 < argc)) {
+		if (prefixName == NULL) logMessage(__func__, LOG_LEVEL_ERROR, "Report-only mode needs a report prefix (-o).\n");
+		else logMessage(__func__, LOG_LEVEL_ERROR, "Report-only mode does not support a second query file.\n");
+		free(hdr_line);
+		free(opt);
+		return 1;
+	}
+
 	if (mode) {
 		if (strcmp(mode, "intractg") == 0) {
 			if (!opt0.o_del) opt->o_del = 16;
@@ -309,14 +328,24 @@ int command_align(int argc, char *argv[]) {
 			break;
 	}
 
-	// Load index
+	// Load index (shared memory, then a mapped container, then separate files)
 	aux.idx = index_load_from_shm(argv[optind]);
-	if (aux.idx == 0) {
+	if (aux.idx) {
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "Loading the index from shared memory...\n");
+	}
+	else if ((aux.idx = index_load_from_container(argv[optind], BWA_IDX_ALL, mapFlags))) {
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "Mapping the index container for reference '%s'...\n", argv[optind]);
+	}
+	else {
 		logMessage(__func__, LOG_LEVEL_MESSAGE, "Loading the index for reference '%s'...\n", argv[optind]);
 		if ((aux.idx = index_load(argv[optind], BWA_IDX_ALL)) == 0) return 1; // FIXME: memory leak
 	}
-	else {
-		logMessage(__func__, LOG_LEVEL_MESSAGE, "Loading the index from shared memory...\n");
+
+	// Index header and files must agree on whether the reverse half is present
+	if (aux.idx->bwt->seq_len != (aux.idx->bns->l_pac << !opt->indexInfo.singleStrand)) {
+		logMessage(__func__, LOG_LEVEL_ERROR, "Index files are inconsistent with the %s-strand header, please reindex the reference.\n",
+				   opt->indexInfo.singleStrand ? "single" : "double");
+		return 1;
 	}
 
 	if (ignore_alt)
@@ -342,7 +371,8 @@ int command_align(int argc, char *argv[]) {
 		}
 
 		// Open files
-		opt->outputStream = err_xopen_core(__func__, samName, "w");
+		if (!(opt->proteinFlag & ALIGN_FLAG_REPORT_ONLY)) opt->outputStream = err_xopen_core(__func__, samName, "w");
+		else opt->outputStream = 0; // no SAM record is generated
 		reportPriStream = err_xopen_core(__func__, reportPriName, "w");
 		if (opt->flag & MEM_F_ALL) reportSecStream = err_xopen_core(__func__, reportSecName, "w");
 
@@ -382,7 +412,7 @@ int command_align(int argc, char *argv[]) {
 	}
 
 	// Render SAM header
-	if (!(opt->flag & MEM_F_ALN_REG)) {
+	if (!(opt->flag & MEM_F_ALN_REG) && opt->outputStream) {
 		bwa_print_sam_hdr(aux.idx->bns, hdr_line, opt->outputStream);
 	}
 
@@ -407,7 +437,7 @@ int command_align(int argc, char *argv[]) {
 	}
 
 	// Cleanup
-	if (opt->outputStream != stdout) fclose (opt->outputStream);
+	if (opt->outputStream && opt->outputStream != stdout) fclose (opt->outputStream);
 	if (reportPriStream) fclose(reportPriStream);
 	if (reportSecStream) fclose(reportSecStream);
 
@@ -444,6 +474,7 @@ int renderAlignUsage(const mem_opt_t * passOptions) {
 
 	fprintf(stderr, "\nAlignment options:\n\n");
 	fprintf(stderr, "       -t INT        number of threads [%d]\n", passOptions->n_threads);
+	fprintf(stderr, "       -i INT        ORFs per thread seeded together, interleaving their index lookups (1 disables) [%d]\n", passOptions->seed_batch);
 	fprintf(stderr, "       -k INT        minimum seed length [%d]\n", passOptions->min_seed_len);
 	fprintf(stderr, "       -d INT        off-diagonal X-dropoff [%d]\n", passOptions->zdrop);
 	fprintf(stderr, "       -r FLOAT      look for internal seeds inside a seed longer than {-k} * FLOAT [%g]\n", passOptions->split_factor);
@@ -475,6 +506,7 @@ int renderAlignUsage(const mem_opt_t * passOptions) {
 	fprintf(stderr, "                        STR_uniprot.tsv - Tab delimited UniProt report (normal alignment mode)\n");
 	fprintf(stderr, "                        STR_uniprot_primary.tsv - Tab delimited UniProt report, primary alignments (all alignments mode)\n");
 	fprintf(stderr, "                        STR_uniprot_secondary.tsv - Tab delimited UniProt report, secondary alignments (all alignments mode)\n\n");
+	fprintf(stderr, "       --report-only only write the UniProt report of {-o}, skipping alignment records and STR.sam\n");
 	fprintf(stderr, "       -u INT        report type generated when using reporting and a UniProt reference [%d]\n", passOptions->outputType);
 	fprintf(stderr, "                        0: Simple ID summary report\n");
 	fprintf(stderr, "                        1: Detailed report (Contacts uniprot.org)\n\n");
@@ -485,6 +517,7 @@ int renderAlignUsage(const mem_opt_t * passOptions) {
 	fprintf(stderr, "       -R STR        read group header line such as '@RG\\tID:foo\\tSM:bar' [null]\n");
 	fprintf(stderr, "       -H STR/FILE   insert STR to header if it starts with @; or insert lines in FILE [null]\n");
 	fprintf(stderr, "       -j            treat ALT contigs as part of the primary assembly (i.e. ignore <idxbase>.alt file)\n");
+	fprintf(stderr, "       -z INT        index container mapping flags: 1=pre-fault pages, 2=transparent huge pages, 3=both [0]\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "       -v INT        verbose level: 1=error, 2=warning, 3=message, 4+=debugging [%d]\n", bwa_verbose);
 	fprintf(stderr, "       -T INT        minimum score to output [%d]\n", passOptions->T);
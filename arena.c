@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#ifdef USE_MALLOC_WRAPPERS
+#  include "malloc_wrap.h"
+#endif
+
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK 0x10000 // first block, enough for the chains and extensions of most ORFs
+#define ARENA_KEEP  0x1000000 // largest capacity kept across resets; beyond it an outlier's blocks are returned
+
+#define arena_round(x) (((x) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define arena_data(b) ((uint8_t*)(b) + arena_round(sizeof(arena_block_t)))
+
+static arena_block_t *arena_block_new(size_t size)
+{
+	arena_block_t *b;
+	b = malloc(arena_round(sizeof(arena_block_t)) + size);
+	b->next = 0;
+	b->size = size;
+	b->used = 0;
+	return b;
+}
+
+arena_t *arena_init(void)
+{
+	return calloc(1, sizeof(arena_t));
+}
+
+void arena_destroy(arena_t *a)
+{
+	arena_block_t *b, *next;
+	if (a == 0) return;
+	for (b = a->head; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+	free(a);
+}
+
+// Release every allocation. Once a sequence needed several blocks, they are merged into one of the same
+// total capacity, so that the following sequences are served without touching the heap
+void arena_reset(arena_t *a)
+{
+	arena_block_t *b, *next;
+	if (a == 0) return;
+	a->last = 0;
+	if (a->head == 0) return;
+	if (a->head->next == 0) {
+		a->head->used = 0;
+		return;
+	}
+	for (b = a->head; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+	a->total = a->total < ARENA_KEEP? a->total : ARENA_BLOCK;
+	a->head = arena_block_new(a->total);
+}
+
+void *arena_alloc(arena_t *a, size_t size)
+{
+	arena_block_t *b;
+	void *p;
+	if (a == 0) return malloc(size);
+	size = size? arena_round(size) : ARENA_ALIGN;
+	if (a->head == 0 || a->head->used + size > a->head->size) { // start a new block, doubling the capacity
+		size_t l = a->total > ARENA_BLOCK? a->total : ARENA_BLOCK;
+		b = arena_block_new(l > size? l : size);
+		b->next = a->head;
+		a->head = b;
+		a->total += b->size;
+	}
+	p = arena_data(a->head) + a->head->used;
+	a->head->used += size;
+	a->last = p;
+	++a->n_alloc;
+	return p;
+}
+
+void *arena_calloc(arena_t *a, size_t n, size_t size)
+{
+	void *p;
+	if (a == 0) return calloc(n, size);
+	p = arena_alloc(a, n * size);
+	memset(p, 0, n * size);
+	return p;
+}
+
+// The old size is needed to copy p out; the most recent allocation grows in place while its block has room
+void *arena_realloc(arena_t *a, void *p, size_t old_size, size_t size)
+{
+	void *q;
+	if (a == 0) return realloc(p, size);
+	if (p == 0) return arena_alloc(a, size);
+	if (p == a->last) {
+		size_t used = (uint8_t*)p - arena_data(a->head) + arena_round(size);
+		if (used <= a->head->size) {
+			a->head->used = used;
+			return p;
+		}
+	}
+	if (size <= old_size) return p;
+	q = arena_alloc(a, size);
+	memcpy(q, p, old_size);
+	return q;
+}
+
+void arena_free(arena_t *a, void *p)
+{
+	if (a == 0) free(p);
+}
@@ -0,0 +1,41 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for the objects a worker builds and drops while aligning one sequence. Allocations are
+ * carved from large blocks and only released together by arena_reset(), so arena_free() does nothing.
+ * Every function also takes a null arena, in which case it falls back to the heap.
+ */
+
+typedef struct arena_block_s {
+	struct arena_block_s *next;
+	size_t size, used;
+} arena_block_t;
+
+typedef struct {
+	arena_block_t *head; // block allocations are served from, in front of those already filled
+	void *last; // most recent allocation, which arena_realloc() can grow in place
+	size_t total; // capacity of all blocks
+	size_t n_alloc; // allocations served since arena_init()
+} arena_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	arena_t *arena_init(void);
+	void arena_destroy(arena_t *a);
+	void arena_reset(arena_t *a);
+
+	void *arena_alloc(arena_t *a, size_t size);
+	void *arena_calloc(arena_t *a, size_t n, size_t size);
+	void *arena_realloc(arena_t *a, void *p, size_t old_size, size_t size);
+	void arena_free(arena_t *a, void *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARENA_H_ */
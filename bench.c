@@ -0,0 +1,669 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "bwa.h"
+#include "bwt.h"
+#include "ksw.h"
+#include "utils.h"
+#include "main.h"
+#include "kseq.h"
+#include "kvec.h"
+
+KSEQ_DECLARE(gzFile)
+
+#ifdef USE_MALLOC_WRAPPERS
+#  include "malloc_wrap.h"
+#endif
+
+// Uniformly sample a BWT coordinate in [0, passMax]
+static bwtint_t getRandomPos(bwtint_t passMax) {
+	return ((bwtint_t)lrand48() << 31 | lrand48()) % (passMax + 1);
+}
+
+// Time bwt_occ() for every single-residue rank kernel available on this CPU, checking they all agree, then
+// bwt_occ4() (counting all residues with the plain histogram) on the same positions
+static int benchOcc(const bwt_t * passBWT, int passCount) {
+	bwtint_t * posList, cnt[VALUE_DOMAIN];
+	uint64_t checkSum, refSum;
+	int kernel, posIdx, valIdx, ret;
+	double t;
+
+	posList = malloc(passCount * sizeof(bwtint_t));
+	for (posIdx = 0 ; posIdx < passCount ; posIdx++) posList[posIdx] = getRandomPos(passBWT->seq_len);
+
+	for (kernel = BWT_RANK_SCALAR, refSum = 0, ret = 0 ; kernel <= BWT_RANK_AVX2 ; kernel++) {
+		if (bwt_rank_select(kernel) < 0) {
+			logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s not supported on this CPU\n", bwt_rank_name(kernel));
+			continue;
+		}
+
+		t = realtime();
+		for (posIdx = 0, checkSum = 0 ; posIdx < passCount ; posIdx++)
+			checkSum += bwt_occ(passBWT, posList[posIdx], posIdx % VALUE_DEFINED) * (posIdx % VALUE_DEFINED + 1);
+		t = realtime() - t;
+
+		if (kernel == BWT_RANK_SCALAR) refSum = checkSum;
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s %8.1f ns/query  %8.2f Mqueries/sec  checksum %016llx%s\n",
+				   bwt_rank_name(kernel), t * 1e9 / passCount, passCount / t / 1e6, (unsigned long long)checkSum,
+				   checkSum == refSum ? "" : "  MISMATCH");
+		if (checkSum != refSum) ret = 1;
+	}
+
+	bwt_rank_select(BWT_RANK_AUTO);
+
+	t = realtime();
+	for (posIdx = 0, checkSum = 0 ; posIdx < passCount ; posIdx++) {
+		bwt_occ4(passBWT, posList[posIdx], cnt);
+		for (valIdx = 0 ; valIdx < VALUE_DEFINED ; valIdx++) checkSum += cnt[valIdx] * (valIdx + 1);
+	}
+	t = realtime() - t;
+	logMessage(__func__, LOG_LEVEL_MESSAGE, "bwt_occ4 %8.1f ns/query  %8.2f Mqueries/sec  checksum %016llx\n",
+			   t * 1e9 / passCount, passCount / t / 1e6, (unsigned long long)checkSum);
+
+	free(posList);
+
+	return ret;
+}
+
+// Time bwt_sa() (one single-residue rank per LF step) on random positions for every rank kernel, then
+// bwt_sa_batch() resolving the same positions in groups, checking the results agree
+static int benchSA(const bwt_t * passBWT, int passCount) {
+	static const int batchList[] = { 1, 8, 32, 256 };
+	bwtint_t * posList, * saList;
+	uint64_t checkSum, refSum;
+	int kernel, posIdx, batchIdx, batch, ret;
+	double t;
+
+	posList = malloc(passCount * sizeof(bwtint_t));
+	saList = malloc(passCount * sizeof(bwtint_t));
+	for (posIdx = 0 ; posIdx < passCount ; posIdx++) posList[posIdx] = getRandomPos(passBWT->seq_len);
+
+	for (kernel = BWT_RANK_SCALAR, refSum = 0, ret = 0 ; kernel <= BWT_RANK_AVX2 ; kernel++) {
+		if (bwt_rank_select(kernel) < 0) continue;
+
+		t = realtime();
+		for (posIdx = 0, checkSum = 0 ; posIdx < passCount ; posIdx++) checkSum += bwt_sa(passBWT, posList[posIdx]) * (posIdx + 1);
+		t = realtime() - t;
+
+		if (kernel == BWT_RANK_SCALAR) refSum = checkSum;
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s %8.1f ns/lookup  %8.2f Mlookups/sec  checksum %016llx%s\n",
+				   bwt_rank_name(kernel), t * 1e9 / passCount, passCount / t / 1e6, (unsigned long long)checkSum,
+				   checkSum == refSum ? "" : "  MISMATCH");
+		if (checkSum != refSum) ret = 1;
+	}
+
+	bwt_rank_select(BWT_RANK_AUTO);
+
+	for (batchIdx = 0 ; batchIdx < sizeof(batchList) / sizeof(batchList[0]) ; batchIdx++) {
+		batch = batchList[batchIdx];
+
+		t = realtime();
+		for (posIdx = 0 ; posIdx < passCount ; posIdx += batch)
+			bwt_sa_batch(passBWT, posIdx + batch < passCount ? batch : passCount - posIdx, posList + posIdx, saList + posIdx);
+		t = realtime() - t;
+
+		for (posIdx = 0, checkSum = 0 ; posIdx < passCount ; posIdx++) checkSum += saList[posIdx] * (posIdx + 1);
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "batch %-3d %8.1f ns/lookup  %8.2f Mlookups/sec  checksum %016llx%s\n",
+				   batch, t * 1e9 / passCount, passCount / t / 1e6, (unsigned long long)checkSum,
+				   checkSum == refSum ? "" : "  MISMATCH");
+		if (checkSum != refSum) ret = 1;
+	}
+
+	free(saList);
+	free(posList);
+
+	return ret;
+}
+
+// Replay the bwt_2occ4() calls made by SMEM search over real reads: report how often K and L share an
+// occurrence interval, and time the paired lookup against two independent bwt_occ4() calls
+static int bench2Occ(const bwt_t * passBWT, const char * passReads, int passCount) {
+	bwtint_t * kList, * lList, cntk[VALUE_DOMAIN], cntl[VALUE_DOMAIN];
+	bwtintv_t ik, ok[VALUE_DOMAIN];
+	uint64_t checkSum[2];
+	uint8_t * seq;
+	gzFile readFile;
+	kseq_t * readSeq;
+	int pairCount, sameCount, posIdx, extIdx, valIdx, pass, dir, c, ret;
+	double t[2];
+
+	if ((readFile = xzopen(passReads, "r")) == 0) return 1;
+	readSeq = kseq_init(readFile);
+	kList = malloc(passCount * sizeof(bwtint_t));
+	lList = malloc(passCount * sizeof(bwtint_t));
+
+	// Emulate the forward then backward extensions of bwt_smem1a() from every read position
+	for (pairCount = 0 ; pairCount < passCount && kseq_read(readSeq) >= 0 ; ) {
+		seq = (uint8_t *) readSeq->seq.s;
+		for (posIdx = 0 ; posIdx < readSeq->seq.l ; posIdx++) seq[posIdx] = aa_encode_hash[seq[posIdx]];
+
+		for (posIdx = 0 ; posIdx < readSeq->seq.l && pairCount < passCount ; posIdx++) {
+			if (seq[posIdx] >= VALUE_DEFINED) continue;
+			bwt_set_intv(passBWT, seq[posIdx], ik);
+
+			for (dir = 0 ; dir < 2 ; dir++) {
+				for (extIdx = dir ? posIdx - 1 : posIdx + 1 ; pairCount < passCount ; extIdx += dir ? -1 : 1) {
+					if (extIdx < 0 || extIdx >= readSeq->seq.l || seq[extIdx] >= VALUE_DEFINED) break;
+					c = dir ? seq[extIdx] : VALUE_DEFINED - 1 - seq[extIdx];
+
+					kList[pairCount] = ik.x[!dir] - 1;
+					lList[pairCount++] = ik.x[!dir] - 1 + ik.x[2];
+					bwt_extend(passBWT, &ik, ok, dir);
+					if (ok[c].x[2] < 1) break;
+					ik = ok[c];
+				}
+			}
+		}
+	}
+
+	kseq_destroy(readSeq);
+	err_gzclose(readFile);
+
+	if (pairCount == 0) {
+		logMessage(__func__, LOG_LEVEL_ERROR, "No extensions traced from %s\n", passReads);
+		free(kList); free(lList);
+		return 1;
+	}
+
+	for (posIdx = 0, sameCount = 0 ; posIdx < pairCount ; posIdx++) {
+		bwtint_t k = kList[posIdx] - (kList[posIdx] >= passBWT->primary), l = lList[posIdx] - (lList[posIdx] >= passBWT->primary);
+		if (kList[posIdx] != (bwtint_t)(-1) && k >> OCC_INTV_SHIFT == l >> OCC_INTV_SHIFT) sameCount++;
+	}
+
+	logMessage(__func__, LOG_LEVEL_MESSAGE, "%d extensions, %.1f%% with both ends in one occurrence interval\n",
+			   pairCount, 100.0 * sameCount / pairCount);
+
+	for (pass = 0 ; pass < 2 ; pass++) {
+		t[pass] = realtime();
+		for (posIdx = 0, checkSum[pass] = 0 ; posIdx < pairCount ; posIdx++) {
+			if (pass) bwt_2occ4(passBWT, kList[posIdx], lList[posIdx], cntk, cntl);
+			else {
+				bwt_occ4(passBWT, kList[posIdx], cntk);
+				bwt_occ4(passBWT, lList[posIdx], cntl);
+			}
+			for (valIdx = 0 ; valIdx < VALUE_DEFINED ; valIdx++) checkSum[pass] += (cntl[valIdx] - cntk[valIdx]) * (valIdx + 1) + cntk[valIdx];
+		}
+		t[pass] = realtime() - t[pass];
+	}
+
+	logMessage(__func__, LOG_LEVEL_MESSAGE, "2x bwt_occ4 %8.1f ns/pair  bwt_2occ4 %8.1f ns/pair  checksum %016llx%s\n",
+			   t[0] * 1e9 / pairCount, t[1] * 1e9 / pairCount, (unsigned long long)checkSum[1],
+			   checkSum[0] == checkSum[1] ? "" : "  MISMATCH");
+	ret = checkSum[0] != checkSum[1];
+
+	free(kList); free(lList);
+
+	return ret;
+}
+
+// Time the first SMEM pass of mem_collect_intv() over protein reads, one read at a time and then with the
+// interleaved search at a few batch sizes, checking every run finds the same seeds
+static int benchSMEM(const bwt_t * passBWT, const char * passReads, int passCount, int passMinLen) {
+	static const int batchSizes[] = {1, 8, 32, 128};
+	uint8_t ** seqList;
+	int * lenList, readCount, readIdx, posIdx, memIdx, batchIdx, batchSize, ret;
+	uint64_t checkSum, refSum, seedCount;
+	bwtintv_v mem1 = {0, 0, 0}, * memList;
+	bwtintv_v * tmpList[2];
+	bwt_t noTable;
+	char label[16];
+	gzFile readFile;
+	kseq_t * readSeq;
+	double t;
+
+	if ((readFile = xzopen(passReads, "r")) == 0) return 1;
+	readSeq = kseq_init(readFile);
+	seqList = malloc(passCount * sizeof(uint8_t *));
+	lenList = malloc(passCount * sizeof(int));
+	for (readCount = 0 ; readCount < passCount && kseq_read(readSeq) >= 0 ; readCount++) {
+		lenList[readCount] = readSeq->seq.l;
+		seqList[readCount] = malloc(readSeq->seq.l);
+		for (posIdx = 0 ; posIdx < readSeq->seq.l ; posIdx++) seqList[readCount][posIdx] = aa_encode_hash[(uint8_t) readSeq->seq.s[posIdx]];
+	}
+	kseq_destroy(readSeq);
+	err_gzclose(readFile);
+
+	memList = calloc(readCount, sizeof(bwtintv_v));
+	tmpList[0] = calloc(1, sizeof(bwtintv_v));
+	tmpList[1] = calloc(1, sizeof(bwtintv_v));
+
+	// With a k-mer interval table, per read seeding extending every residue comes first, as the reference
+	noTable = *passBWT;
+	noTable.kmer_len = 0;
+
+	for (batchIdx = passBWT->kmer_len ? -1 : 0, refSum = 0, ret = 0 ; batchIdx < (int) (sizeof(batchSizes) / sizeof(batchSizes[0])) ; batchIdx++) {
+		batchSize = batchIdx < 0 ? 1 : batchSizes[batchIdx];
+		for (readIdx = 0 ; readIdx < readCount ; readIdx++) memList[readIdx].n = 0;
+
+		t = realtime();
+		if (batchSize == 1) {
+			// As mem_collect_intv()
+			for (readIdx = 0 ; readIdx < readCount ; readIdx++) {
+				for (posIdx = 0 ; posIdx < lenList[readIdx] ; ) {
+					if (seqList[readIdx][posIdx] >= VALUE_DEFINED) {
+						posIdx++;
+						continue;
+					}
+					posIdx = bwt_smem1(batchIdx < 0 ? &noTable : passBWT, lenList[readIdx], seqList[readIdx], posIdx, 1, &mem1, tmpList);
+					for (memIdx = 0 ; memIdx < mem1.n ; memIdx++) {
+						if ((uint32_t)mem1.a[memIdx].info - (mem1.a[memIdx].info >> 32) >= passMinLen) kv_push(bwtintv_t, memList[readIdx], mem1.a[memIdx]);
+					}
+				}
+			}
+		}
+		else {
+			for (readIdx = 0 ; readIdx < readCount ; readIdx += batchSize) {
+				bwt_smem1_batch(passBWT, readCount - readIdx < batchSize ? readCount - readIdx : batchSize, lenList + readIdx,
+								(const uint8_t * const *) seqList + readIdx, 1, passMinLen, memList + readIdx);
+			}
+		}
+		t = realtime() - t;
+
+		for (readIdx = 0, checkSum = 0, seedCount = 0 ; readIdx < readCount ; readIdx++) {
+			for (memIdx = 0 ; memIdx < memList[readIdx].n ; memIdx++, seedCount++) {
+				checkSum = checkSum * 31 + memList[readIdx].a[memIdx].x[0] + memList[readIdx].a[memIdx].x[2] + memList[readIdx].a[memIdx].info;
+			}
+		}
+
+		if (batchIdx == (passBWT->kmer_len ? -1 : 0)) refSum = checkSum;
+		if (batchIdx < 0) sprintf(label, "no table");
+		else sprintf(label, "batch %d", batchSize);
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "%-10s %10.0f seeds/sec  %8.1f us/read  %llu seeds  checksum %016llx%s\n",
+				   label, seedCount / t, t * 1e6 / readCount, (unsigned long long)seedCount, (unsigned long long)checkSum,
+				   checkSum == refSum ? "" : "  MISMATCH");
+		if (checkSum != refSum) ret = 1;
+	}
+
+	for (readIdx = 0 ; readIdx < readCount ; readIdx++) {
+		free(seqList[readIdx]);
+		free(memList[readIdx].a);
+	}
+	free(tmpList[0]->a); free(tmpList[1]->a);
+	free(tmpList[0]); free(tmpList[1]);
+	free(mem1.a);
+	free(memList); free(seqList); free(lenList);
+
+	return ret;
+}
+
+// Time bns_pos2rid() on random forward positions with the bucket table, then with a binary search over the annotations
+static int benchRID(bntseq_t * passBNS, int passCount) {
+	int64_t * posList, * ridOff;
+	uint64_t checkSum, refSum;
+	int posIdx, pass, ret;
+	double t;
+
+	posList = malloc(passCount * sizeof(int64_t));
+	for (posIdx = 0 ; posIdx < passCount ; posIdx++) posList[posIdx] = getRandomPos(passBNS->l_pac - 1);
+	ridOff = passBNS->rid_off;
+
+	for (pass = 0, refSum = 0, ret = 0 ; pass < 2 ; pass++) {
+		// Hiding the packed offsets makes bns_pos2rid fall back to the binary search
+		passBNS->rid_off = pass ? 0 : ridOff;
+
+		t = realtime();
+		for (posIdx = 0, checkSum = 0 ; posIdx < passCount ; posIdx++) checkSum += (uint64_t)bns_pos2rid(passBNS, posList[posIdx]) * (posIdx + 1);
+		t = realtime() - t;
+
+		if (!pass) refSum = checkSum;
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s %8.1f ns/lookup  %8.2f Mlookups/sec  checksum %016llx%s\n",
+				   pass ? "bsearch" : "bucket", t * 1e9 / passCount, passCount / t / 1e6, (unsigned long long)checkSum,
+				   checkSum == refSum ? "" : "  MISMATCH");
+		if (checkSum != refSum) ret = 1;
+	}
+
+	passBNS->rid_off = ridOff;
+	free(posList);
+
+	return ret;
+}
+
+// One ksw_extend2() problem; left extensions (rev) read query and target backwards from their ends
+typedef struct {
+	uint8_t * query, * target;
+	int qlen, tlen, rev, matIdx, h0, w, zdrop, endBonus, oDel, eDel, oIns, eIns;
+} ExtTask;
+
+#define EXT_MATRICES 4
+
+// Append a random pair: the target is a mutated copy of the query (substitutions and short indels) followed
+// by an unrelated tail, with random scoring. A few tasks start from a large h0 to reach the 16-bit and scalar paths
+static void addRandomExt(ExtTask * passTask) {
+	int qlen, posIdx, tIdx, r;
+
+	qlen = 1 + lrand48() % 400;
+	passTask->qlen = qlen;
+	passTask->query = malloc(qlen);
+	passTask->target = malloc(2 * qlen + 64);
+	for (posIdx = 0 ; posIdx < qlen ; posIdx++) passTask->query[posIdx] = lrand48() % VALUE_DEFINED;
+
+	for (posIdx = 0, tIdx = 0 ; posIdx < qlen ; posIdx++) {
+		r = lrand48() % 100;
+		if (r < 2) continue; // deletion from the target
+		if (r < 4) passTask->target[tIdx++] = lrand48() % VALUE_DEFINED; // insertion
+		passTask->target[tIdx++] = r < 15 ? lrand48() % VALUE_DEFINED : passTask->query[posIdx];
+	}
+	for (r = lrand48() % 64 ; r > 0 ; r--) passTask->target[tIdx++] = lrand48() % VALUE_DEFINED;
+	if (tIdx == 0) passTask->target[tIdx++] = lrand48() % VALUE_DEFINED;
+	passTask->tlen = tIdx;
+
+	passTask->rev = lrand48() & 1;
+	passTask->matIdx = lrand48() % EXT_MATRICES;
+	r = lrand48() % 100;
+	passTask->h0 = r < 90 ? 1 + lrand48() % 60 : (r < 98 ? 200 + lrand48() % 2000 : 32000 + lrand48() % 2000);
+	passTask->w = 1 + lrand48() % 120;
+	passTask->zdrop = lrand48() % 4 ? 20 + lrand48() % 100 : 0;
+	passTask->endBonus = lrand48() % 4 ? 0 : lrand48() % 10;
+	passTask->oDel = lrand48() % 7;
+	passTask->eDel = 1 + lrand48() % 3;
+	passTask->oIns = lrand48() % 7;
+	passTask->eIns = 1 + lrand48() % 3;
+}
+
+// Collect the left and right extensions of the longest SMEM of every protein read, as mem_chain2aln() would
+// set them up with the default scoring
+static int addReadExts(const bwaidx_t * passIdx, const char * passReads, int passCount, ExtTask * passTasks, int passTaskCount) {
+	bwtintv_v mem = {0, 0, 0};
+	bwtintv_v * tmpList[2];
+	bwtintv_t best;
+	uint8_t * seq, * rseq;
+	int64_t rb, re, rbeg, lPac;
+	int readCount, posIdx, memIdx, qbeg, qend, seedLen, rid;
+	gzFile readFile;
+	kseq_t * readSeq;
+	ExtTask * task;
+
+	if ((readFile = xzopen(passReads, "r")) == 0) return -1;
+	readSeq = kseq_init(readFile);
+	tmpList[0] = calloc(1, sizeof(bwtintv_v));
+	tmpList[1] = calloc(1, sizeof(bwtintv_v));
+	lPac = passIdx->bns->l_pac;
+
+	for (readCount = 0 ; readCount < passCount && passTaskCount + 2 <= 2 * passCount && kseq_read(readSeq) >= 0 ; readCount++) {
+		seq = (uint8_t *) readSeq->seq.s;
+		for (posIdx = 0 ; posIdx < readSeq->seq.l ; posIdx++) seq[posIdx] = aa_encode_hash[seq[posIdx]];
+
+		for (posIdx = 0, seedLen = 0 ; posIdx < readSeq->seq.l ; ) {
+			if (seq[posIdx] >= VALUE_DEFINED) {
+				posIdx++;
+				continue;
+			}
+			posIdx = bwt_smem1(passIdx->bwt, readSeq->seq.l, seq, posIdx, 1, &mem, tmpList);
+			for (memIdx = 0 ; memIdx < mem.n ; memIdx++) {
+				if ((uint32_t)mem.a[memIdx].info - (mem.a[memIdx].info >> 32) > seedLen) {
+					best = mem.a[memIdx];
+					seedLen = (uint32_t)best.info - (best.info >> 32);
+				}
+			}
+		}
+		if (seedLen < 11) continue;
+
+		qbeg = best.info >> 32;
+		qend = (uint32_t)best.info;
+		rbeg = bwt_sa(passIdx->bwt, best.x[0]);
+
+		// Reference window covering both extensions at the default bandwidth, kept on the seed's strand
+		rb = rbeg - qbeg - 100;
+		re = rbeg + seedLen + (readSeq->seq.l - qend) + 100;
+		if (rb < 0) rb = 0;
+		if (re > lPac << 1) re = lPac << 1;
+		if (rb < lPac && lPac < re) {
+			if (rbeg < lPac) re = lPac;
+			else rb = lPac;
+		}
+		rseq = bns_fetch_seq(passIdx->bns, passIdx->pac, &rb, rbeg, &re, &rid);
+
+		task = passTasks + passTaskCount;
+		if (qbeg > 0 && rbeg > rb) {
+			task->query = malloc(qbeg);
+			memcpy(task->query, seq, qbeg);
+			task->qlen = qbeg;
+			task->target = malloc(rbeg - rb);
+			memcpy(task->target, rseq, rbeg - rb);
+			task->tlen = rbeg - rb;
+			task->rev = 1;
+			task++;
+		}
+		if (qend < readSeq->seq.l && rbeg + seedLen < re) {
+			task->query = malloc(readSeq->seq.l - qend);
+			memcpy(task->query, seq + qend, readSeq->seq.l - qend);
+			task->qlen = readSeq->seq.l - qend;
+			task->target = malloc(re - rbeg - seedLen);
+			memcpy(task->target, rseq + (rbeg + seedLen - rb), re - rbeg - seedLen);
+			task->tlen = re - rbeg - seedLen;
+			task->rev = 0;
+			task++;
+		}
+		for ( ; passTasks + passTaskCount < task ; passTaskCount++) {
+			passTasks[passTaskCount].matIdx = 0;
+			passTasks[passTaskCount].h0 = seedLen;
+			passTasks[passTaskCount].w = 100;
+			passTasks[passTaskCount].zdrop = 100;
+			passTasks[passTaskCount].endBonus = 0;
+			passTasks[passTaskCount].oDel = passTasks[passTaskCount].oIns = 0;
+			passTasks[passTaskCount].eDel = passTasks[passTaskCount].eIns = 1;
+		}
+		free(rseq);
+	}
+
+	kseq_destroy(readSeq);
+	err_gzclose(readFile);
+	free(tmpList[0]->a); free(tmpList[1]->a);
+	free(tmpList[0]); free(tmpList[1]);
+	free(mem.a);
+
+	return passTaskCount;
+}
+
+static void freeExtTasks(ExtTask * passTasks, int passCount) {
+	int taskIdx;
+
+	for (taskIdx = 0 ; taskIdx < passCount ; taskIdx++) {
+		free(passTasks[taskIdx].query);
+		free(passTasks[taskIdx].target);
+	}
+	free(passTasks);
+}
+
+// Build passCount random pairs followed by the seed extensions of up to passCount reads (their number in
+// retRealCount), and the scoring matrices they refer to
+static ExtTask * makeExtTasks(const bwaidx_t * passIdx, const char * passReads, int passCount, int * retRealCount, int8_t retMat[EXT_MATRICES][VALUE_SCORING]) {
+	ExtTask * taskList;
+	int taskIdx;
+
+	// Default scoring first, as used for the read extensions
+	bwa_fill_scmat(1, 3, retMat[0]);
+	bwa_fill_scmat(1, 1, retMat[1]);
+	bwa_fill_scmat(2, 4, retMat[2]);
+	bwa_fill_scmat(5, 2, retMat[3]);
+
+	taskList = calloc(3 * passCount, sizeof(ExtTask));
+	for (taskIdx = 0 ; taskIdx < passCount ; taskIdx++) addRandomExt(taskList + taskIdx);
+	if ((*retRealCount = addReadExts(passIdx, passReads, passCount, taskList + passCount, 0)) < 0) {
+		freeExtTasks(taskList, passCount);
+		return 0;
+	}
+
+	return taskList;
+}
+
+// Time ksw_extend2() for every kernel on random pairs, then on the seed extensions of protein reads, checking
+// that all outputs agree with the scalar kernel
+static int benchExt(const bwaidx_t * passIdx, const char * passReads, int passCount) {
+	int8_t matList[EXT_MATRICES][VALUE_SCORING];
+	int * outList, * out, realCount, taskIdx, part, kernel, mismatch, ret;
+	uint64_t cellCount;
+	ExtTask * taskList, * task;
+	double t;
+
+	if ((taskList = makeExtTasks(passIdx, passReads, passCount, &realCount, matList)) == 0) return 1;
+	outList = malloc((size_t)(passCount + realCount) * 6 * sizeof(int));
+
+	for (part = 0, ret = 0 ; part < 2 ; part++) {
+		ExtTask * first = part ? taskList + passCount : taskList;
+		int count = part ? realCount : passCount;
+
+		for (taskIdx = 0, cellCount = 0 ; taskIdx < count ; taskIdx++) cellCount += (uint64_t)first[taskIdx].qlen * first[taskIdx].tlen;
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "%d %s extensions, %.0f query x target cells on average\n", count,
+				   part ? "read seed" : "random", count ? (double)cellCount / count : 0.0);
+		if (count == 0) continue;
+
+		for (kernel = KSW_EXT_SCALAR ; kernel <= KSW_EXT_AVX2 ; kernel++) {
+			if (ksw_extend_select(kernel) < 0) {
+				logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s not supported on this CPU\n", ksw_extend_name(kernel));
+				continue;
+			}
+
+			t = realtime();
+			for (taskIdx = 0, mismatch = 0 ; taskIdx < count ; taskIdx++) {
+				int res[6];
+				task = first + taskIdx;
+				res[0] = (task->rev ? ksw_extend2_rev : ksw_extend2)(task->qlen, task->query, task->tlen, task->target, VALUE_DEFINED, matList[task->matIdx],
+						task->oDel, task->eDel, task->oIns, task->eIns, task->w, task->endBonus, task->zdrop, task->h0,
+						&res[1], &res[2], &res[3], &res[4], &res[5]);
+				out = outList + (size_t)(first - taskList + taskIdx) * 6;
+				if (kernel == KSW_EXT_SCALAR) memcpy(out, res, sizeof(res));
+				else if (memcmp(out, res, sizeof(res))) mismatch++;
+			}
+			t = realtime() - t;
+
+			logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s %8.2f us/extension  %10.0f extensions/sec  %d mismatches%s\n",
+					   ksw_extend_name(kernel), t * 1e6 / count, count / t, mismatch, mismatch ? "  MISMATCH" : "");
+			if (mismatch) ret = 1;
+		}
+	}
+
+	ksw_extend_select(KSW_EXT_AUTO);
+	freeExtTasks(taskList, passCount + realCount);
+	free(outList);
+
+	return ret;
+}
+
+// Time ksw_align2() at every vector width, then as picked by query length, on the same pairs as benchExt(),
+// aligned locally with byte and 16-bit cells, with and without start positions and suboptimal hits, checking
+// all results agree with SSE2
+static int benchSW(const bwaidx_t * passIdx, const char * passReads, int passCount) {
+	static const int xtraList[] = { KSW_XSTART, KSW_XBYTE | KSW_XSTART, KSW_XSUBO | KSW_XSTART | 20, KSW_XBYTE };
+	static const int kernelList[] = { KSW_ALIGN_SSE2, KSW_ALIGN_AVX2, KSW_ALIGN_AVX512, KSW_ALIGN_AUTO };
+	int8_t matList[EXT_MATRICES][VALUE_SCORING];
+	int realCount, taskIdx, part, kernelIdx, kernel, mismatch, ret;
+	kswr_t * outList, res;
+	ExtTask * taskList, * task;
+	double t;
+
+	if ((taskList = makeExtTasks(passIdx, passReads, passCount, &realCount, matList)) == 0) return 1;
+	outList = malloc((size_t)(passCount + realCount) * sizeof(kswr_t));
+
+	for (part = 0, ret = 0 ; part < 2 ; part++) {
+		ExtTask * first = part ? taskList + passCount : taskList;
+		int count = part ? realCount : passCount;
+
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "%d %s alignments\n", count, part ? "read seed" : "random");
+		if (count == 0) continue;
+
+		for (kernelIdx = 0 ; kernelIdx < sizeof(kernelList) / sizeof(kernelList[0]) ; kernelIdx++) {
+			kernel = kernelList[kernelIdx];
+			if (ksw_align_select(kernel) < 0) {
+				logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s not supported on this CPU\n", ksw_align_name(kernel));
+				continue;
+			}
+
+			t = realtime();
+			for (taskIdx = 0, mismatch = 0 ; taskIdx < count ; taskIdx++) {
+				task = first + taskIdx;
+				res = ksw_align2(task->qlen, task->query, task->tlen, task->target, VALUE_DEFINED, matList[task->matIdx],
+						task->oDel, task->eDel, task->oIns, task->eIns, xtraList[taskIdx & 3], 0);
+				if (kernel == KSW_ALIGN_SSE2) outList[first - taskList + taskIdx] = res;
+				else if (memcmp(&outList[first - taskList + taskIdx], &res, sizeof(res))) mismatch++;
+			}
+			t = realtime() - t;
+
+			logMessage(__func__, LOG_LEVEL_MESSAGE, "%-8s %8.2f us/alignment  %10.0f alignments/sec  %d mismatches%s\n",
+					   ksw_align_name(kernel), t * 1e6 / count, count / t, mismatch, mismatch ? "  MISMATCH" : "");
+			if (mismatch) ret = 1;
+		}
+	}
+
+	ksw_align_select(KSW_ALIGN_AUTO);
+	freeExtTasks(taskList, passCount + realCount);
+	free(outList);
+
+	return ret;
+}
+
+static int renderBenchUsage() {
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Usage: paladin bench [options] <test> <idxbase> [reads.fa]\n\n");
+	fprintf(stderr, "Tests:\n\n");
+	fprintf(stderr, "    occ        single-residue rank kernels used by bwt_occ, then bwt_occ4 (random positions)\n");
+	fprintf(stderr, "    sa         suffix array lookups through bwt_sa and bwt_sa_batch (random positions)\n");
+	fprintf(stderr, "    2occ       paired bwt_2occ4 lookups replayed from SMEM extension of protein reads\n");
+	fprintf(stderr, "    rid        reference ID lookups through bns_pos2rid (random positions)\n");
+	fprintf(stderr, "    smem       first SMEM pass over protein reads, per read and interleaved (-n reads)\n");
+	fprintf(stderr, "    ext        banded extension kernels of ksw_extend2 (-n random pairs, then seeds of -n reads)\n");
+	fprintf(stderr, "    sw         local alignment widths of ksw_align2 on the pairs of the ext test\n\n");
+	fprintf(stderr, "Options:\n\n");
+	fprintf(stderr, "    -n INT     number of queries [1000000]\n");
+	fprintf(stderr, "\n");
+
+	return 1;
+}
+
+// 'bench' command entry point.  Microbenchmarks for index kernels
+int command_bench(int argc, char *argv[]) {
+	bwt_t * bwt;
+	bwaidx_t * idx;
+	int c, count, ret;
+
+	count = 1000000;
+	while ((c = getopt(argc, argv, "n:")) >= 0) {
+		if (c == 'n') count = atoi(optarg);
+		else return renderBenchUsage();
+	}
+
+	if ((optind + 2 > argc) || (optind + 3 < argc) || (count < 1)) return renderBenchUsage();
+
+	srand48(11);
+
+	if ((strcmp(argv[optind], "occ") == 0) && (optind + 2 == argc)) {
+		if ((bwt = index_load_bwt(argv[optind + 1])) == 0) return 1;
+		ret = benchOcc(bwt, count);
+		bwt_destroy(bwt);
+	}
+	else if ((strcmp(argv[optind], "sa") == 0) && (optind + 2 == argc)) {
+		if ((bwt = index_load_bwt(argv[optind + 1])) == 0) return 1;
+		ret = benchSA(bwt, count);
+		bwt_destroy(bwt);
+	}
+	else if ((strcmp(argv[optind], "2occ") == 0) && (optind + 3 == argc)) {
+		if ((bwt = index_load_bwt(argv[optind + 1])) == 0) return 1;
+		ret = bench2Occ(bwt, argv[optind + 2], count);
+		bwt_destroy(bwt);
+	}
+	else if ((strcmp(argv[optind], "smem") == 0) && (optind + 3 == argc)) {
+		if ((bwt = index_load_bwt(argv[optind + 1])) == 0) return 1;
+		ret = benchSMEM(bwt, argv[optind + 2], count, 11);
+		bwt_destroy(bwt);
+	}
+	else if ((strcmp(argv[optind], "ext") == 0) && (optind + 3 == argc)) {
+		if ((idx = index_load_from_disk(argv[optind + 1], BWA_IDX_ALL)) == 0) return 1;
+		ret = benchExt(idx, argv[optind + 2], count);
+		index_destroy(idx);
+	}
+	else if ((strcmp(argv[optind], "sw") == 0) && (optind + 3 == argc)) {
+		if ((idx = index_load_from_disk(argv[optind + 1], BWA_IDX_ALL)) == 0) return 1;
+		ret = benchSW(idx, argv[optind + 2], count);
+		index_destroy(idx);
+	}
+	else if ((strcmp(argv[optind], "rid") == 0) && (optind + 2 == argc)) {
+		if ((idx = index_load_from_disk(argv[optind + 1], BWA_IDX_BNS)) == 0) return 1;
+		ret = benchRID(idx->bns, count);
+		index_destroy(idx);
+	}
+	else return renderBenchUsage();
+
+	return ret;
+}
@@ -4,6 +4,9 @@
 #include <zlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "bntseq.h"
 #include "utils.h"
 #include "bwt.h"
@@ -18,6 +21,11 @@ KHASH_MAP_INIT_STR(str, int)
 #  include "malloc_wrap.h"
 #endif
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#  define BNS_PAC_X86
+#  include <immintrin.h>
+#endif
+
 unsigned char nst_nt4_table[256] = {
 	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
 	4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 4,
@@ -107,11 +115,105 @@ unsigned char aa_ascii_hash[256] = {
    'X', 'X', 'X', 'X', 'X', 'X', 'X', 'X', // 0xF8
 };
 
+char *bns_ann_pool(const bntseq_t *bns, bntann1_t *recs, int64_t *l_pool)
+{
+	int64_t l, k;
+	char *pool;
+	int i;
+
+	for (i = 0, l = 0; i < bns->n_seqs; ++i)
+		l += strlen(bns->anns[i].name) + strlen(bns->anns[i].anno) + 2;
+	pool = malloc(l > 0? l : 1);
+
+	// "(null)" is how an empty comment is held before the index is written, and reads back as empty
+	memcpy(recs, bns->anns, bns->n_seqs * sizeof(bntann1_t));
+	for (i = 0, k = 0; i < bns->n_seqs; ++i) {
+		const char *anno = strcmp(bns->anns[i].anno, "(null)") == 0? "" : bns->anns[i].anno;
+		recs[i].name = (char*)(uintptr_t)k;
+		l = strlen(bns->anns[i].name) + 1; memcpy(pool + k, bns->anns[i].name, l); k += l;
+		recs[i].anno = (char*)(uintptr_t)k;
+		l = strlen(anno) + 1; memcpy(pool + k, anno, l); k += l;
+	}
+	*l_pool = k;
+	return pool;
+}
+
+int bns_ann_bind(bntann1_t *recs, int n_recs, char *pool, int64_t l_pool)
+{
+	int i;
+	if (n_recs > 0 && (l_pool <= 0 || pool[l_pool - 1] != 0)) return 0; // every string must end within the pool
+	for (i = 0; i < n_recs; ++i)
+		if ((uintptr_t)recs[i].name >= l_pool || (uintptr_t)recs[i].anno >= l_pool) return 0;
+	for (i = 0; i < n_recs; ++i) {
+		recs[i].name = pool + (uintptr_t)recs[i].name;
+		recs[i].anno = pool + (uintptr_t)recs[i].anno;
+	}
+	return 1;
+}
+
+static void bns_dump_annb(const bntseq_t *bns, const char *fn)
+{
+	bntannb_hdr_t hdr;
+	bntann1_t *recs;
+	char *pool;
+	FILE *fp;
+	int i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = BNS_ANNB_MAGIC;
+	hdr.l_pac = bns->l_pac, hdr.n_seqs = bns->n_seqs, hdr.seed = bns->seed;
+	recs = malloc((bns->n_seqs > 0? bns->n_seqs : 1) * sizeof(bntann1_t));
+	pool = bns_ann_pool(bns, recs, &hdr.l_names);
+	for (i = 0; i < bns->n_seqs; ++i) recs[i].is_alt = 0; // set from .alt at load, as with the text .ann
+
+	fp = xopen(fn, "wb");
+	err_fwrite(&hdr, sizeof(hdr), 1, fp);
+	err_fwrite(recs, sizeof(bntann1_t), bns->n_seqs, fp);
+	err_fwrite(pool, 1, hdr.l_names, fp);
+	err_fflush(fp);
+	err_fclose(fp);
+	free(recs);
+	free(pool);
+}
+
+// Map a binary annotation table privately: records are fixed up in place (copying only their pages), names stay shared
+static int bns_restore_annb(bntseq_t *bns, const char *fn)
+{
+	bntannb_hdr_t hdr;
+	struct stat st;
+	uint8_t *mem;
+	int fd;
+
+	if ((fd = open(fn, O_RDONLY)) < 0) return 0;
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(hdr) || read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != BNS_ANNB_MAGIC
+			|| hdr.n_seqs < 0 || hdr.l_names < 0 || st.st_size != sizeof(hdr) + hdr.n_seqs * sizeof(bntann1_t) + hdr.l_names) {
+		close(fd);
+		return 0;
+	}
+	mem = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) return 0;
+
+	if (!bns_ann_bind((bntann1_t*)(mem + sizeof(hdr)), hdr.n_seqs, (char*)(mem + sizeof(hdr) + hdr.n_seqs * sizeof(bntann1_t)), hdr.l_names)) {
+		logMessage(__func__, LOG_LEVEL_WARNING, "Corrupt annotation table '%s', reading the text annotations instead\n", fn);
+		munmap(mem, st.st_size);
+		return 0;
+	}
+	bns->l_pac = hdr.l_pac, bns->n_seqs = hdr.n_seqs, bns->seed = hdr.seed;
+	bns->anns = (bntann1_t*)(mem + sizeof(hdr));
+	bns->ann_mem = mem, bns->l_ann_mem = st.st_size;
+	return 1;
+}
+
 void bns_dump(const bntseq_t *bns, const char *prefix)
 {
 	char str[1024];
 	FILE *fp;
 	int i;
+	{ // dump .annb, with the text .ann kept for older readers
+		strcpy(str, prefix); strcat(str, ".annb");
+		bns_dump_annb(bns, str);
+	}
 	{ // dump .ann
 		strcpy(str, prefix); strcat(str, ".ann");
 		fp = xopen(str, "w");
@@ -149,7 +251,8 @@ bntseq_t *bns_restore_core(const char *ann_filename, const char* amb_filename, c
 	int i;
 	int scanres;
 	bns = (bntseq_t*)calloc(1, sizeof(bntseq_t));
-	{ // read .ann
+	strcat(strcpy(str, ann_filename), "b");
+	if (!bns_restore_annb(bns, str)) { // read .ann when there is no binary table
 		fp = xopen(fname = ann_filename, "r");
 		scanres = fscanf(fp, "%lld%d%u", &xx, &bns->n_seqs, &bns->seed);
 		if (scanres != 3) goto badread;
@@ -201,6 +304,7 @@ bntseq_t *bns_restore_core(const char *ann_filename, const char* amb_filename, c
 	{ // open .pac
 		bns->fp_pac = xopen(pac_filename, "rb");
 	}
+	bns_rid_build(bns);
 	return bns;
 
  badread:
@@ -255,12 +359,16 @@ void bns_destroy(bntseq_t *bns)
 	else {
 		int i;
 		if (bns->fp_pac) err_fclose(bns->fp_pac);
+		bns_rid_destroy(bns);
 		free(bns->ambs);
-		for (i = 0; i < bns->n_seqs; ++i) {
-			free(bns->anns[i].name);
-			free(bns->anns[i].anno);
+		if (bns->ann_mem) munmap(bns->ann_mem, bns->l_ann_mem);
+		else {
+			for (i = 0; i < bns->n_seqs; ++i) {
+				free(bns->anns[i].name);
+				free(bns->anns[i].anno);
+			}
+			free(bns->anns);
 		}
-		free(bns->anns);
 		free(bns);
 	}
 }
@@ -329,15 +437,14 @@ uint8_t *add1(const kseq_t *seq, bntseq_t *bns, uint8_t *pac, int64_t *m_pac, in
 	return pac;
 }
 
-int64_t bns_fasta2bntseq(gzFile fp_fa, const char * prefix, int for_only) {
+// Read every sequence of the FASTA into an unpacked buffer, one residue per byte
+static bntseq_t *bns_fasta_read(gzFile fp_fa, uint8_t **ret_pac) {
 	kseq_t *seq;
-	char name[1024];
 	bntseq_t *bns;
 	uint8_t *pac = 0;
 	int32_t m_seqs, m_holes;
-	int64_t ret = -1, m_pac, l;
+	int64_t m_pac;
 	bntamb1_t *q;
-	FILE *fp;
 
 	// Initialization of sequence related structures
 	seq = kseq_init(fp_fa);
@@ -352,29 +459,162 @@ int64_t bns_fasta2bntseq(gzFile fp_fa, const char * prefix, int for_only) {
 	// Allocate packed buffer to size of sequence (for now - to be converted to 40-bit word)
 	pac = calloc(m_pac, 1);
 
-	// Open packed file for writing
-	strcpy(name, prefix); strcat(name, ".pac");
-	fp = xopen(name, "wb");
-
 	// Read sequences into pac buffer
 	while (kseq_read(seq) >= 0) pac = add1(seq, bns, pac, &m_pac, &m_seqs, &m_holes, &q);
 
-	// Add reverse complement if not forward only
-	if (!for_only) {
-		m_pac = bns->l_pac * 2;
-		pac = realloc(pac, m_pac);
-		memset(pac + bns->l_pac, 0, m_pac - bns->l_pac);
+	kseq_destroy(seq);
+	*ret_pac = pac;
+	return bns;
+}
 
-		for (l = bns->l_pac - 1; l >= 0; --l, ++bns->l_pac) {
-			pac[bns->l_pac] = VALUE_DEFINED - 1 - pac[l];
-		}
+// Append the reverse complement of the first l_pac residues
+static uint8_t *bns_pac_add_rev(uint8_t *pac, int64_t l_pac) {
+	int64_t l;
+
+	pac = realloc(pac, l_pac * 2);
+	for (l = 0; l < l_pac; ++l) {
+		pac[l_pac * 2 - 1 - l] = VALUE_DEFINED - 1 - pac[l];
 	}
 
-	ret = bns->l_pac;
+	return pac;
+}
+
+/************************
+ * 5-bit packed residues *
+ ************************/
+/* Groups of 8 residues are stored as 40-bit little-endian values at 5 * group, residue j of a group in
+ * bits 5j..5j+4. A group is unpacked from one unaligned 8-byte load, so the buffer carries 3 bytes of
+ * slack past the last group. */
+
+#define pac5_size(l) ((((l) + 7) >> 3) * 5 + 3)
+
+static inline int pac5_get(const uint8_t *pac, int64_t l)
+{
+	uint64_t x;
+
+	memcpy(&x, pac + (l >> 3) * 5, sizeof(x));
+	return x >> (l & 7) * 5 & 31;
+}
+
+// Unpack N whole groups from group G into 8 * N bytes of SEQ
+static void pac5_groups_scalar(const uint8_t *pac, int64_t g, int64_t n, uint8_t *seq)
+{
+	uint64_t x, y;
+	int j;
+
+	for (; n > 0; --n, ++g, seq += 8) {
+		memcpy(&x, pac + g * 5, sizeof(x));
+		for (j = 0, y = 0; j < 8; ++j) y |= (x >> 5 * j & 31) << 8 * j;
+		memcpy(seq, &y, sizeof(y));
+	}
+}
+
+#ifdef BNS_PAC_X86
+// One bit deposit spreads the 8 fields of a group over 8 bytes
+__attribute__((target("bmi2")))
+static void pac5_groups_bmi2(const uint8_t *pac, int64_t g, int64_t n, uint8_t *seq)
+{
+	uint64_t x, y;
+
+	for (; n > 0; --n, ++g, seq += 8) {
+		memcpy(&x, pac + g * 5, sizeof(x));
+		y = _pdep_u64(x, 0x1f1f1f1f1f1f1f1fULL);
+		memcpy(seq, &y, sizeof(y));
+	}
+}
+#endif
+
+typedef void (*pac5_groups_f)(const uint8_t *pac, int64_t g, int64_t n, uint8_t *seq);
+static void pac5_groups_resolve(const uint8_t *pac, int64_t g, int64_t n, uint8_t *seq);
+static pac5_groups_f pac5_groups = pac5_groups_resolve;
+
+// Kernel picked on first use; every thread resolves to the same function, so the race is benign
+static void pac5_groups_resolve(const uint8_t *pac, int64_t g, int64_t n, uint8_t *seq)
+{
+	pac5_groups = pac5_groups_scalar;
+#ifdef BNS_PAC_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("bmi2")) pac5_groups = pac5_groups_bmi2;
+#endif
+	pac5_groups(pac, g, n, seq);
+}
 
-	// Write pac file
+// Residues BEG..END-1 into SEQ
+static void pac5_unpack(const uint8_t *pac, int64_t beg, int64_t end, uint8_t *seq)
+{
+	int64_t n;
+
+	for (; beg < end && (beg & 7); ++beg) *seq++ = pac5_get(pac, beg);
+	if ((n = (end - beg) >> 3) > 0) {
+		pac5_groups(pac, beg >> 3, n, seq);
+		seq += n << 3, beg += n << 3;
+	}
+	for (; beg < end; ++beg) *seq++ = pac5_get(pac, beg);
+}
+
+static uint8_t *pac5_pack(const uint8_t *seq, int64_t l)
+{
+	uint8_t *pac;
+	uint64_t x;
+	int64_t i;
+
+	pac = calloc(pac5_size(l), 1);
+	for (i = 0; i < l; ++i) {
+		memcpy(&x, pac + (i >> 3) * 5, sizeof(x));
+		x |= (uint64_t)seq[i] << (i & 7) * 5;
+		memcpy(pac + (i >> 3) * 5, &x, sizeof(x));
+	}
+	return pac;
+}
+
+int64_t bns_pac_size(const bntseq_t *bns)
+{
+	return bns->pac_packed? pac5_size(bns->l_pac) : bns->l_pac + 1;
+}
+
+uint8_t *bns_pac_read(bntseq_t *bns)
+{
+	uint64_t magic = 0;
+	int64_t l_pac;
+	uint8_t *pac;
+
+	if (fread(&magic, sizeof(magic), 1, bns->fp_pac) != 1) magic = 0;
+	if (magic == BNS_PAC_MAGIC) {
+		err_fread_noeof(&l_pac, sizeof(l_pac), 1, bns->fp_pac);
+		xassert(l_pac == bns->l_pac, "inconsistent .ann and .pac files.");
+		bns->pac_packed = 1;
+		pac = calloc(bns_pac_size(bns), 1);
+		err_fread_noeof(pac, 1, pac5_size(l_pac) - 3, bns->fp_pac);
+	} else {
+		bns->pac_packed = 0;
+		err_fseek(bns->fp_pac, 0, SEEK_SET);
+		pac = calloc(bns_pac_size(bns), 1);
+		err_fread_noeof(pac, 1, bns->l_pac + 1, bns->fp_pac); // one residue per byte
+	}
+	return pac;
+}
+
+// Write the pac file
+static void bns_pac_dump(const uint8_t *pac, int64_t l_pac, const char *prefix, int packed) {
+	char name[1024];
 	ubyte_t ct;
-	err_fwrite(pac, 1, bns->l_pac, fp);
+	uint64_t magic = BNS_PAC_MAGIC;
+	uint8_t *buf;
+	FILE *fp;
+
+	strcpy(name, prefix); strcat(name, ".pac");
+	fp = xopen(name, "wb");
+	if (packed) { // Format: <magic><l_pac><groups of 8 residues in 5 bytes>
+		buf = pac5_pack(pac, l_pac);
+		err_fwrite(&magic, sizeof(magic), 1, fp);
+		err_fwrite(&l_pac, sizeof(l_pac), 1, fp);
+		err_fwrite(buf, 1, pac5_size(l_pac) - 3, fp);
+		free(buf);
+		err_fflush(fp);
+		err_fclose(fp);
+		return;
+	}
+	err_fwrite(pac, 1, l_pac, fp);
 
 	// Pad to nearest 40-bit word
 	ct = 0;
@@ -386,12 +626,48 @@ int64_t bns_fasta2bntseq(gzFile fp_fa, const char * prefix, int for_only) {
 	// Close pac file
 	err_fflush(fp);
 	err_fclose(fp);
+}
+
+int64_t bns_fasta2bntseq(gzFile fp_fa, const char * prefix, int for_only) {
+	bntseq_t *bns;
+	uint8_t *pac;
+	int64_t ret;
+
+	bns = bns_fasta_read(fp_fa, &pac);
+
+	// Add reverse complement if not forward only
+	if (!for_only) {
+		pac = bns_pac_add_rev(pac, bns->l_pac);
+		bns->l_pac <<= 1;
+	}
 
+	ret = bns->l_pac;
+
+	bns_pac_dump(pac, bns->l_pac, prefix, 0);
 	bns_dump(bns, prefix);
 	bns_destroy(bns);
-	kseq_destroy(seq);
 	free(pac);
-	return ret;}
+	return ret;
+}
+
+uint8_t *bns_fasta2pac(gzFile fp_fa, const char *prefix, int for_only, int packed, int64_t *l_seq) {
+	bntseq_t *bns;
+	uint8_t *pac;
+
+	// Files only ever hold the forward strand
+	bns = bns_fasta_read(fp_fa, &pac);
+	bns_pac_dump(pac, bns->l_pac, prefix, packed);
+	bns_dump(bns, prefix);
+
+	*l_seq = bns->l_pac;
+	if (!for_only) {
+		pac = bns_pac_add_rev(pac, bns->l_pac);
+		*l_seq <<= 1;
+	}
+
+	bns_destroy(bns);
+	return pac;
+}
 
 int bwa_fa2pac(int argc, char *argv[])
 {
@@ -412,10 +688,52 @@ int bwa_fa2pac(int argc, char *argv[])
 	return 0;
 }
 
+void bns_rid_build(bntseq_t *bns)
+{
+	int64_t b, n_bkt;
+	int i, r;
+
+	bns_rid_destroy(bns);
+	if (bns->n_seqs == 0) return;
+
+	// Offsets packed eight to a cache line, rather than one per 40-byte record
+	bns->rid_off = malloc((bns->n_seqs + 1) * sizeof(int64_t));
+	for (i = 0; i < bns->n_seqs; ++i) bns->rid_off[i] = bns->anns[i].offset;
+	bns->rid_off[bns->n_seqs] = bns->l_pac;
+
+	// About two sequences per bucket, so a lookup usually scans a couple of neighbouring offsets
+	for (bns->rid_shift = 0; (bns->l_pac >> bns->rid_shift) > (bns->n_seqs >> 1); ++bns->rid_shift);
+	n_bkt = ((bns->l_pac - 1) >> bns->rid_shift) + 2;
+	bns->rid_bkt = malloc(n_bkt * sizeof(int32_t));
+	for (b = 0, r = 0; b < n_bkt; ++b) {
+		while (r + 1 < bns->n_seqs && bns->rid_off[r + 1] <= b << bns->rid_shift) ++r;
+		bns->rid_bkt[b] = r;
+	}
+}
+
+void bns_rid_destroy(bntseq_t *bns)
+{
+	free(bns->rid_off); bns->rid_off = 0;
+	free(bns->rid_bkt); bns->rid_bkt = 0;
+}
+
 int bns_pos2rid(const bntseq_t *bns, int64_t pos_f)
 {
 	int left, mid, right;
 	if (pos_f >= bns->l_pac) return -1;
+	if (bns->rid_off) {
+		// The ID lies between those of this bucket's first position and the next bucket's
+		const int64_t *off = bns->rid_off;
+		left = bns->rid_bkt[pos_f >> bns->rid_shift];
+		right = bns->rid_bkt[(pos_f >> bns->rid_shift) + 1];
+		while (right - left > 8) {
+			mid = (left + right + 1) >> 1;
+			if (off[mid] <= pos_f) left = mid;
+			else right = mid - 1;
+		}
+		while (left < right && off[left + 1] <= pos_f) ++left;
+		return left;
+	}
 	left = 0; mid = 0; right = bns->n_seqs;
 	while (left < right) { // binary search
 		mid = (left + right) >> 1;
@@ -461,8 +779,15 @@ int bns_cnt_ambi(const bntseq_t *bns, int64_t pos_f, int len, int *ref_id)
 	return nn;
 }
 
-uint8_t *bns_get_seq(int64_t l_pac, const uint8_t *pac, int64_t beg, int64_t end, int64_t *len)
+uint8_t *bns_get_seq(const bntseq_t *bns, const uint8_t *pac, int64_t beg, int64_t end, int64_t *len)
+{
+	return bns_get_seq2(bns, pac, beg, end, len, 0);
+}
+
+// As bns_get_seq(), writing into buf (of at least |end - beg| bytes) when given
+uint8_t *bns_get_seq2(const bntseq_t *bns, const uint8_t *pac, int64_t beg, int64_t end, int64_t *len, uint8_t *buf)
 {
+	int64_t l_pac = bns->l_pac;
 	uint8_t *seq = 0;
 	if (end < beg) end ^= beg, beg ^= end, end ^= beg; // if end is smaller, swap
 	if (end > l_pac<<1) end = l_pac<<1;
@@ -470,8 +795,17 @@ uint8_t *bns_get_seq(int64_t l_pac, const uint8_t *pac, int64_t beg, int64_t end
 	if (beg >= l_pac || end <= l_pac) {
 		int64_t k, l = 0;
 		*len = end - beg;
-		seq = malloc(end - beg);
-		if (beg >= l_pac) { // reverse strand
+		seq = buf? buf : malloc(end - beg);
+		if (bns->pac_packed) { // unpack the forward residues, then reverse and complement them in place
+			if (beg >= l_pac) {
+				pac5_unpack(pac, (l_pac<<1) - end, (l_pac<<1) - beg, seq);
+				for (k = 0; k < (*len + 1) >> 1; ++k) {
+					uint8_t tmp = VALUE_DEFINED - 1 - seq[k];
+					seq[k] = VALUE_DEFINED - 1 - seq[*len - 1 - k];
+					seq[*len - 1 - k] = tmp;
+				}
+			} else pac5_unpack(pac, beg, end, seq);
+		} else if (beg >= l_pac) { // reverse strand
 			int64_t beg_f = (l_pac<<1) - 1 - end;
 			int64_t end_f = (l_pac<<1) - 1 - beg;
 			for (k = end_f; k > beg_f; --k)
@@ -487,6 +821,12 @@ uint8_t *bns_get_seq(int64_t l_pac, const uint8_t *pac, int64_t beg, int64_t end
 }
 
 uint8_t *bns_fetch_seq(const bntseq_t *bns, const uint8_t *pac, int64_t *beg, int64_t mid, int64_t *end, int *rid)
+{
+	return bns_fetch_seq2(bns, pac, beg, mid, end, rid, 0);
+}
+
+// As bns_fetch_seq(), writing into buf (of at least |*end - *beg| bytes, the range only shrinks) when given
+uint8_t *bns_fetch_seq2(const bntseq_t *bns, const uint8_t *pac, int64_t *beg, int64_t mid, int64_t *end, int *rid, uint8_t *buf)
 {
 	int64_t far_beg, far_end, len;
 	int is_rev;
@@ -504,7 +844,7 @@ uint8_t *bns_fetch_seq(const bntseq_t *bns, const uint8_t *pac, int64_t *beg, in
 	}
 	*beg = *beg > far_beg? *beg : far_beg;
 	*end = *end < far_end? *end : far_end;
-	seq = bns_get_seq(bns->l_pac, pac, *beg, *end, &len);
+	seq = bns_get_seq2(bns, pac, *beg, *end, &len, buf);
 	if (seq == 0 || *end - *beg != len) {
 		fprintf(stderr, "[E::%s] begin=%ld, mid=%ld, end=%ld, len=%ld, seq=%p, rid=%d, far_beg=%ld, far_end=%ld\n",
 				__func__, (long)*beg, (long)mid, (long)*end, (long)len, seq, *rid, (long)far_beg, (long)far_end);
@@ -61,8 +61,31 @@ typedef struct {
 	int32_t n_holes;
 	bntamb1_t *ambs; // n_holes elements
 	FILE *fp_pac;
+	uint8_t *ann_mem; // mapped .annb holding anns and their names, if loaded from it
+	int64_t l_ann_mem;
+	// Position to ID lookup built at load: packed offsets (n_seqs + 1, the last being l_pac), and for
+	// each 2^rid_shift residue bucket the ID holding its first position
+	int64_t *rid_off;
+	int32_t *rid_bkt;
+	int rid_shift;
+	int pac_packed; // the loaded pac holds 5 bits per residue (see bns_pac_size) instead of one byte
 } bntseq_t;
 
+// Binary annotation table (.annb): this header, n_seqs bntann1_t records with name and anno
+// holding offsets into the string pool, then the pool of name\0anno\0 entries
+#define BNS_ANNB_MAGIC 0x31424e4e41444c50ULL // "PLDANNB1"
+
+// Leads .pac files holding 5-bit residues, followed by l_pac (files without it hold one byte per residue)
+#define BNS_PAC_MAGIC 0x3530434150444c50ULL // "PLDPAC05"
+
+typedef struct {
+	uint64_t magic;
+	int64_t l_pac;
+	int32_t n_seqs;
+	uint32_t seed;
+	int64_t l_names;
+} bntannb_hdr_t;
+
 extern unsigned char aa_encode_hash[256];
 extern unsigned char aa_ascii_hash[256];
 
@@ -74,11 +97,27 @@ extern "C" {
 	bntseq_t *bns_restore(const char *prefix);
 	bntseq_t *bns_restore_core(const char *ann_filename, const char* amb_filename, const char* pac_filename);
 	void bns_destroy(bntseq_t *bns);
+	// Copy the annotations into recs with names replaced by offsets into the returned pool
+	char *bns_ann_pool(const bntseq_t *bns, bntann1_t *recs, int64_t *l_pool);
+	// Turn pool offsets in recs back into pointers; returns 0, leaving recs untouched, if one lies outside the pool
+	int bns_ann_bind(bntann1_t *recs, int n_recs, char *pool, int64_t l_pool);
+	// Build or free the position to ID lookup used by bns_pos2rid
+	void bns_rid_build(bntseq_t *bns);
+	void bns_rid_destroy(bntseq_t *bns);
 	int64_t bns_fasta2bntseq(gzFile fp_fa, const char *prefix, int for_only);
+	// Write the forward-only .pac/.ann/.amb and return the unpacked sequence, with its reverse complement appended unless for_only
+	// The .pac holds 5 bits per residue when packed
+	uint8_t *bns_fasta2pac(gzFile fp_fa, const char *prefix, int for_only, int packed, int64_t *l_seq);
+	// Read the .pac opened by bns_restore(), setting pac_packed from its header
+	uint8_t *bns_pac_read(bntseq_t *bns);
+	// Bytes of the loaded pac: l_pac + 1, or 8 residues per 5 bytes plus slack for 8-byte group loads
+	int64_t bns_pac_size(const bntseq_t *bns);
 	int bns_pos2rid(const bntseq_t *bns, int64_t pos_f);
 	int bns_cnt_ambi(const bntseq_t *bns, int64_t pos_f, int len, int *ref_id);
-	uint8_t *bns_get_seq(int64_t l_pac, const uint8_t *pac, int64_t beg, int64_t end, int64_t *len);
+	uint8_t *bns_get_seq(const bntseq_t *bns, const uint8_t *pac, int64_t beg, int64_t end, int64_t *len);
 	uint8_t *bns_fetch_seq(const bntseq_t *bns, const uint8_t *pac, int64_t *beg, int64_t mid, int64_t *end, int *rid);
+	uint8_t *bns_get_seq2(const bntseq_t *bns, const uint8_t *pac, int64_t beg, int64_t end, int64_t *len, uint8_t *buf);
+	uint8_t *bns_fetch_seq2(const bntseq_t *bns, const uint8_t *pac, int64_t *beg, int64_t mid, int64_t *end, int *rid, uint8_t *buf);
 	int bns_intv2rid(const bntseq_t *bns, int64_t rb, int64_t re);
 
 #ifdef __cplusplus
@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include <zlib.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "bntseq.h"
 #include "bwa.h"
 #include "ksw.h"
@@ -118,8 +122,9 @@ void bwa_fill_scmat(int a, int b, int8_t mat[VALUE_SCORING])
 }
 
 // Generate CIGAR when the alignment end points are known
-uint32_t *bwa_gen_cigar2(const int8_t mat[VALUE_SCORING], int o_del, int e_del, int o_ins, int e_ins, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM)
+uint32_t *bwa_gen_cigar2(const int8_t mat[VALUE_SCORING], int o_del, int e_del, int o_ins, int e_ins, int w_, const bntseq_t *bns, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM)
 {
+	int64_t l_pac = bns->l_pac;
 	uint32_t *cigar = 0;
 	uint8_t tmp, *rseq;
 	int i;
@@ -130,7 +135,7 @@ uint32_t *bwa_gen_cigar2(const int8_t mat[VALUE_SCORING], int o_del, int e_del,
 	if (n_cigar) *n_cigar = 0;
 	if (NM) *NM = -1;
 	if (l_query <= 0 || rb >= re || (rb < l_pac && re > l_pac)) return 0; // reject if negative length or bridging the forward and reverse strand
-	rseq = bns_get_seq(l_pac, pac, rb, re, &rlen);
+	rseq = bns_get_seq(bns, pac, rb, re, &rlen);
 	if (re - rb != rlen) goto ret_gen_cigar; // possible if out of range
 	if (rb >= l_pac) { // then reverse both query and rseq; this is to ensure indels to be placed at the leftmost position
 		for (i = 0; i < l_query>>1; ++i)
@@ -206,9 +211,9 @@ ret_gen_cigar:
 	return cigar;
 }
 
-uint32_t *bwa_gen_cigar(const int8_t mat[VALUE_SCORING], int q, int r, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM)
+uint32_t *bwa_gen_cigar(const int8_t mat[VALUE_SCORING], int q, int r, int w_, const bntseq_t *bns, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM)
 {
-	return bwa_gen_cigar2(mat, q, r, q, r, w_, l_pac, pac, l_query, query, rb, re, score, n_cigar, NM);
+	return bwa_gen_cigar2(mat, q, r, q, r, w_, bns, pac, l_query, query, rb, re, score, n_cigar, NM);
 }
 
 /*********************
@@ -244,11 +249,13 @@ bwt_t *index_load_bwt(const char *hint)
 		logMessage(__func__, LOG_LEVEL_ERROR, "Failed to locate the index files\n");
 		return 0;
 	}
-	tmp = calloc(strlen(prefix) + 5, 1);
+	tmp = calloc(strlen(prefix) + 6, 1);
 	strcat(strcpy(tmp, prefix), ".bwt"); // FM-index
 	bwt = bwt_restore_bwt(tmp);
 	strcat(strcpy(tmp, prefix), ".sa");  // partial suffix array (SA)
 	bwt_restore_sa(tmp, bwt);
+	strcat(strcpy(tmp, prefix), ".kmer"); // k-mer interval table, if built
+	bwt_restore_kmer(tmp, bwt);
 	free(tmp); free(prefix);
 	return bwt;
 }
@@ -279,8 +286,7 @@ bwaidx_t *index_load_from_disk(const char *hint, int which)
 		logMessage(__func__, LOG_LEVEL_MESSAGE, "Read %d ALT contigs\n", c);
 
 		if (which & BWA_IDX_PAC) {
-			idx->pac = calloc(idx->bns->l_pac+1, 1);
-			err_fread_noeof(idx->pac, 1, idx->bns->l_pac+1, idx->bns->fp_pac); // concatenated 2-bit encoded sequence
+			idx->pac = bns_pac_read(idx->bns); // one residue per byte, or 5 bits each
 			err_fclose(idx->bns->fp_pac);
 			idx->bns->fp_pac = 0;
 		}
@@ -303,12 +309,180 @@ void index_destroy(bwaidx_t *idx)
 		if (idx->bns) bns_destroy(idx->bns);
 		if (idx->pac) free(idx->pac);
 	} else {
-		free(idx->bwt); free(idx->bns->anns); free(idx->bns);
-		if (!idx->is_shm) free(idx->mem);
+		free(idx->bwt);
+		if (idx->bns) {
+			bns_rid_destroy(idx->bns);
+			free(idx->bns->anns);
+		}
+		free(idx->bns);
+		if (idx->is_mmap) munmap(idx->mem, idx->l_mem);
+		else if (!idx->is_shm) free(idx->mem);
 	}
 	free(idx);
 }
 
+/*****************************
+ * Single-file index container *
+ *****************************/
+
+static void ctn_write_section(FILE *fp, bwactn_hdr_t *hdr, int sec, const void *data, int64_t size)
+{
+	static const uint8_t zero[BWA_CTN_ALIGN] = {0};
+	int64_t pad;
+
+	hdr->offset[sec] = err_ftell(fp);
+	hdr->size[sec] = size;
+	if (size) err_fwrite(data, 1, size, fp);
+
+	// Pad to the next page
+	pad = (BWA_CTN_ALIGN - size % BWA_CTN_ALIGN) % BWA_CTN_ALIGN;
+	if (pad) err_fwrite(zero, 1, pad, fp);
+}
+
+int index_dump_container(const bwaidx_t *idx, const char *hint)
+{
+	static const uint8_t zero[BWA_CTN_ALIGN] = {0};
+	bwactn_hdr_t hdr;
+	bntann1_t *anns;
+	char *names, *fn;
+	int64_t l_names;
+	FILE *fp;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = BWA_CTN_MAGIC;
+	hdr.version = BWA_CTN_VERSION;
+	hdr.bwt = *idx->bwt;
+	hdr.bwt.bwt = 0, hdr.bwt.sa = 0, hdr.bwt.kmer = 0;
+	hdr.bns = *idx->bns;
+	hdr.bns.anns = 0, hdr.bns.ambs = 0, hdr.bns.fp_pac = 0, hdr.bns.ann_mem = 0, hdr.bns.l_ann_mem = 0;
+	hdr.bns.rid_off = 0, hdr.bns.rid_bkt = 0;
+
+	// Names and comments are pooled, the records keep their offsets
+	anns = malloc((idx->bns->n_seqs > 0? idx->bns->n_seqs : 1) * sizeof(bntann1_t));
+	names = bns_ann_pool(idx->bns, anns, &l_names);
+
+	fn = malloc(strlen(hint) + 6);
+	strcat(strcpy(fn, hint), ".pidx");
+	fp = xopen(fn, "wb");
+
+	// Header page first, rewritten once the sections are placed
+	err_fwrite(zero, 1, BWA_CTN_ALIGN, fp);
+	ctn_write_section(fp, &hdr, BWA_CTN_BWT, idx->bwt->bwt, idx->bwt->bwt_size * sizeof(uint32_t));
+	ctn_write_section(fp, &hdr, BWA_CTN_SA, idx->bwt->sa, bwt_sa_words(idx->bwt) * sizeof(bwtint_t));
+	ctn_write_section(fp, &hdr, BWA_CTN_PAC, idx->pac, bns_pac_size(idx->bns));
+	ctn_write_section(fp, &hdr, BWA_CTN_AMB, idx->bns->ambs, idx->bns->n_holes * sizeof(bntamb1_t));
+	ctn_write_section(fp, &hdr, BWA_CTN_ANN, anns, idx->bns->n_seqs * sizeof(bntann1_t));
+	ctn_write_section(fp, &hdr, BWA_CTN_NAME, names, l_names);
+	ctn_write_section(fp, &hdr, BWA_CTN_KMER, idx->bwt->kmer, bwt_kmer_count(idx->bwt->kmer_len) * 3 * sizeof(bwtint_t));
+	err_fseek(fp, 0, SEEK_SET);
+	err_fwrite(&hdr, sizeof(hdr), 1, fp);
+	err_fflush(fp);
+	err_fclose(fp);
+
+	free(names);
+	free(anns);
+	free(fn);
+	return 0;
+}
+
+// Whether every section is page-aligned, lies within the file and has the size its header fields imply
+static int ctn_check_sections(const bwactn_hdr_t *hdr, int64_t l_file)
+{
+	uint64_t expected[BWA_CTN_SECTIONS];
+	int i;
+
+	if (hdr->bns.n_seqs < 0 || hdr->bns.n_holes < 0 || hdr->bwt.kmer_len < 0 || hdr->bwt.kmer_len > BWT_KMER_MAX) return 0;
+	expected[BWA_CTN_BWT] = hdr->bwt.bwt_size * sizeof(uint32_t);
+	expected[BWA_CTN_SA] = bwt_sa_words(&hdr->bwt) * sizeof(bwtint_t);
+	expected[BWA_CTN_PAC] = bns_pac_size(&hdr->bns);
+	expected[BWA_CTN_AMB] = hdr->bns.n_holes * sizeof(bntamb1_t);
+	expected[BWA_CTN_ANN] = hdr->bns.n_seqs * sizeof(bntann1_t);
+	expected[BWA_CTN_NAME] = hdr->size[BWA_CTN_NAME]; // checked against the records when they are bound
+	expected[BWA_CTN_KMER] = bwt_kmer_count(hdr->bwt.kmer_len) * 3 * sizeof(bwtint_t);
+	for (i = 0; i < BWA_CTN_SECTIONS; ++i) {
+		if (hdr->offset[i] < BWA_CTN_ALIGN || hdr->offset[i] % BWA_CTN_ALIGN || hdr->offset[i] > l_file) return 0;
+		if (hdr->size[i] != expected[i] || hdr->size[i] > l_file - hdr->offset[i]) return 0;
+	}
+	return 1;
+}
+
+bwaidx_t *index_load_from_container(const char *hint, int which, int flags)
+{
+	bwaidx_t *idx;
+	bwactn_hdr_t hdr;
+	struct stat st;
+	uint8_t *mem;
+	char *fn;
+	int fd, mmapFlags;
+
+	fn = malloc(strlen(hint) + 6);
+	strcat(strcpy(fn, hint), ".pidx");
+	fd = open(fn, O_RDONLY);
+	free(fn);
+	if (fd < 0) return 0;
+
+	if (fstat(fd, &st) < 0 || st.st_size < BWA_CTN_ALIGN || read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.magic != BWA_CTN_MAGIC) {
+		logMessage(__func__, LOG_LEVEL_ERROR, "'%s.pidx' is not an index container\n", hint);
+		close(fd);
+		return 0;
+	}
+	if (hdr.version != BWA_CTN_VERSION) {
+		logMessage(__func__, LOG_LEVEL_ERROR, "'%s.pidx' is container version %u, expected %d; please rebuild it\n", hint, hdr.version, BWA_CTN_VERSION);
+		close(fd);
+		return 0;
+	}
+	if (!ctn_check_sections(&hdr, st.st_size)) {
+		logMessage(__func__, LOG_LEVEL_ERROR, "'%s.pidx' is truncated or corrupt; please rebuild it\n", hint);
+		close(fd);
+		return 0;
+	}
+
+	// Shared read-only mapping, so processes aligning against the same index share its page cache
+	mmapFlags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	if (flags & BWA_MAP_POPULATE) mmapFlags |= MAP_POPULATE;
+#endif
+	mem = mmap(0, st.st_size, PROT_READ, mmapFlags, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		logMessage(__func__, LOG_LEVEL_ERROR, "Failed to map '%s.pidx'\n", hint);
+		return 0;
+	}
+#ifdef MADV_HUGEPAGE
+	if (flags & BWA_MAP_HUGEPAGE) madvise(mem, st.st_size, MADV_HUGEPAGE);
+#endif
+
+	idx = calloc(1, sizeof(bwaidx_t));
+	idx->mem = mem, idx->l_mem = st.st_size, idx->is_mmap = 1;
+
+	if (which & BWA_IDX_BWT) {
+		idx->bwt = malloc(sizeof(bwt_t));
+		*idx->bwt = hdr.bwt;
+		idx->bwt->bwt = (uint32_t*)(mem + hdr.offset[BWA_CTN_BWT]);
+		idx->bwt->sa = (bwtint_t*)(mem + hdr.offset[BWA_CTN_SA]);
+		idx->bwt->kmer = idx->bwt->kmer_len? (bwtint_t*)(mem + hdr.offset[BWA_CTN_KMER]) : 0;
+	}
+	if (which & BWA_IDX_BNS) {
+		idx->bns = malloc(sizeof(bntseq_t));
+		*idx->bns = hdr.bns;
+		idx->bns->rid_off = 0, idx->bns->rid_bkt = 0;
+		idx->bns->ambs = (bntamb1_t*)(mem + hdr.offset[BWA_CTN_AMB]);
+
+		// Records are copied to point at the pooled names
+		idx->bns->anns = malloc(hdr.size[BWA_CTN_ANN]);
+		memcpy(idx->bns->anns, mem + hdr.offset[BWA_CTN_ANN], hdr.size[BWA_CTN_ANN]);
+		if (!bns_ann_bind(idx->bns->anns, idx->bns->n_seqs, (char*)(mem + hdr.offset[BWA_CTN_NAME]), hdr.size[BWA_CTN_NAME])) {
+			logMessage(__func__, LOG_LEVEL_ERROR, "'%s.pidx' has corrupt reference names; please rebuild it\n", hint);
+			index_destroy(idx);
+			return 0;
+		}
+		bns_rid_build(idx->bns);
+		if (which & BWA_IDX_PAC) idx->pac = mem + hdr.offset[BWA_CTN_PAC];
+	}
+
+	return idx;
+}
+
 int bwa_mem2idx(int64_t l_mem, uint8_t *mem, bwaidx_t *idx)
 {
 	int64_t k = 0, x;
@@ -317,7 +491,8 @@ int bwa_mem2idx(int64_t l_mem, uint8_t *mem, bwaidx_t *idx)
 	// generate idx->bwt
 	x = sizeof(bwt_t); idx->bwt = malloc(x); memcpy(idx->bwt, mem + k, x); k += x;
 	x = idx->bwt->bwt_size * 4; idx->bwt->bwt = (uint32_t*)(mem + k); k += x;
-	x = idx->bwt->n_sa * sizeof(bwtint_t); idx->bwt->sa = (bwtint_t*)(mem + k); k += x;
+	x = bwt_sa_words(idx->bwt) * sizeof(bwtint_t); idx->bwt->sa = (bwtint_t*)(mem + k); k += x;
+	x = bwt_kmer_count(idx->bwt->kmer_len) * 3 * sizeof(bwtint_t); idx->bwt->kmer = x? (bwtint_t*)(mem + k) : 0; k += x;
 
 	// generate idx->bns and idx->pac
 	x = sizeof(bntseq_t); idx->bns = malloc(x); memcpy(idx->bns, mem + k, x); k += x;
@@ -327,8 +502,10 @@ int bwa_mem2idx(int64_t l_mem, uint8_t *mem, bwaidx_t *idx)
 		idx->bns->anns[i].name = (char*)(mem + k); k += strlen(idx->bns->anns[i].name) + 1;
 		idx->bns->anns[i].anno = (char*)(mem + k); k += strlen(idx->bns->anns[i].anno) + 1;
 	}
+	idx->bns->rid_off = 0, idx->bns->rid_bkt = 0;
+	bns_rid_build(idx->bns);
 	//idx->pac = (uint8_t*)(mem + k); k += idx->bns->l_pac/4+1;
-	idx->pac = (uint8_t*)(mem + k); k += idx->bns->l_pac+1;
+	idx->pac = (uint8_t*)(mem + k); k += bns_pac_size(idx->bns);
 	assert(k == l_mem);
 
 	idx->l_mem = k; idx->mem = mem;
@@ -346,8 +523,12 @@ int bwa_idx2mem(bwaidx_t *idx)
 	mem = realloc(idx->bwt->bwt, sizeof(bwt_t) + x); idx->bwt->bwt = 0;
 	memmove(mem + sizeof(bwt_t), mem, x);
 	memcpy(mem, idx->bwt, sizeof(bwt_t)); k = sizeof(bwt_t) + x;
-	x = idx->bwt->n_sa * sizeof(bwtint_t); mem = realloc(mem, k + x); memcpy(mem + k, idx->bwt->sa, x); k += x;
+	x = bwt_sa_words(idx->bwt) * sizeof(bwtint_t); mem = realloc(mem, k + x); memcpy(mem + k, idx->bwt->sa, x); k += x;
 	free(idx->bwt->sa);
+	if (idx->bwt->kmer_len) {
+		x = bwt_kmer_count(idx->bwt->kmer_len) * 3 * sizeof(bwtint_t); mem = realloc(mem, k + x); memcpy(mem + k, idx->bwt->kmer, x); k += x;
+		free(idx->bwt->kmer);
+	}
 	free(idx->bwt); idx->bwt = 0;
 
 	// copy idx->bns
@@ -355,23 +536,20 @@ int bwa_idx2mem(bwaidx_t *idx)
 	for (i = 0; i < idx->bns->n_seqs; ++i) // compute the size of heap-allocated memory
 		tmp += strlen(idx->bns->anns[i].name) + strlen(idx->bns->anns[i].anno) + 2;
 	mem = realloc(mem, k + sizeof(bntseq_t) + tmp);
-	x = sizeof(bntseq_t); memcpy(mem + k, idx->bns, x); k += x;
+	x = sizeof(bntseq_t); memcpy(mem + k, idx->bns, x); ((bntseq_t*)(mem + k))->ann_mem = 0; k += x;
 	x = idx->bns->n_holes * sizeof(bntamb1_t); memcpy(mem + k, idx->bns->ambs, x); k += x;
-	free(idx->bns->ambs);
 	x = idx->bns->n_seqs * sizeof(bntann1_t); memcpy(mem + k, idx->bns->anns, x); k += x;
 	for (i = 0; i < idx->bns->n_seqs; ++i) {
 		x = strlen(idx->bns->anns[i].name) + 1; memcpy(mem + k, idx->bns->anns[i].name, x); k += x;
 		x = strlen(idx->bns->anns[i].anno) + 1; memcpy(mem + k, idx->bns->anns[i].anno, x); k += x;
-		free(idx->bns->anns[i].name); free(idx->bns->anns[i].anno);
 	}
-	free(idx->bns->anns);
 
 	// copy idx->pac
 	//x = idx->bns->l_pac/4+1;
-	x = idx->bns->l_pac+1;
+	x = bns_pac_size(idx->bns);
 	mem = realloc(mem, k + x);
 	memcpy(mem + k, idx->pac, x); k += x;
-	free(idx->bns); idx->bns = 0;
+	bns_destroy(idx->bns); idx->bns = 0;
 	free(idx->pac); idx->pac = 0;
 
 	return bwa_mem2idx(k, mem, idx);
@@ -12,16 +12,41 @@
 
 #define BWA_CTL_SIZE 0x10000
 
+// Single-file index container: a header page, then page-aligned bwt, sa, pac, amb, ann and name sections
+#define BWA_CTN_MAGIC   0x33584449444c4150ULL // "PALDIDX3"
+#define BWA_CTN_VERSION 1 // bumped whenever the sections or the bwt_t/bntseq_t embedded in the header change
+#define BWA_CTN_ALIGN   4096
+#define BWA_CTN_BWT     0
+#define BWA_CTN_SA      1
+#define BWA_CTN_PAC     2
+#define BWA_CTN_AMB     3
+#define BWA_CTN_ANN     4 // bntann1_t records, name and anno holding offsets into the name section
+#define BWA_CTN_NAME    5
+#define BWA_CTN_KMER    6 // k-mer interval table, empty if not built
+#define BWA_CTN_SECTIONS 7
+
+// Container mapping flags
+#define BWA_MAP_POPULATE 0x1 // pre-fault every page at load
+#define BWA_MAP_HUGEPAGE 0x2 // advise transparent huge pages
+
 typedef struct {
 	bwt_t    *bwt; // FM-index
 	bntseq_t *bns; // information on the reference sequences
 	uint8_t  *pac; // the actual 2-bit encoded reference sequences with 'N' converted to a random base
 
-	int    is_shm;
+	int    is_shm, is_mmap;
 	int64_t l_mem;
 	uint8_t  *mem;
 } bwaidx_t;
 
+typedef struct {
+	uint64_t magic;
+	uint32_t version;
+	uint64_t offset[BWA_CTN_SECTIONS], size[BWA_CTN_SECTIONS];
+	bwt_t bwt; // scalar fields only
+	bntseq_t bns; // scalar fields only
+} bwactn_hdr_t;
+
 typedef struct {
 	int l_seq, id;
 	char *name, *comment, *seq, *qual, *sam;
@@ -38,8 +63,8 @@ extern "C" {
 	void bseq_classify(int n, bseq1_t *seqs, int m[2], bseq1_t *sep[2]);
 
 	void bwa_fill_scmat(int a, int b, int8_t mat[VALUE_SCORING]);
-	uint32_t *bwa_gen_cigar(const int8_t mat[VALUE_SCORING], int q, int r, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM);
-	uint32_t *bwa_gen_cigar2(const int8_t mat[VALUE_SCORING], int o_del, int e_del, int o_ins, int e_ins, int w_, int64_t l_pac, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM);
+	uint32_t *bwa_gen_cigar(const int8_t mat[VALUE_SCORING], int q, int r, int w_, const bntseq_t *bns, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM);
+	uint32_t *bwa_gen_cigar2(const int8_t mat[VALUE_SCORING], int o_del, int e_del, int o_ins, int e_ins, int w_, const bntseq_t *bns, const uint8_t *pac, int l_query, uint8_t *query, int64_t rb, int64_t re, int *score, int *n_cigar, int *NM);
 
 	char *index_infer_prefix(const char *hint);
 	bwt_t *index_load_bwt(const char *hint);
@@ -47,6 +72,8 @@ extern "C" {
 	bwaidx_t *index_load_from_shm(const char *hint);
 	bwaidx_t *index_load_from_disk(const char *hint, int which);
 	bwaidx_t *index_load(const char *hint, int which);
+	bwaidx_t *index_load_from_container(const char *hint, int which, int flags);
+	int index_dump_container(const bwaidx_t *idx, const char *hint);
 	void index_destroy(bwaidx_t *idx);
 	int bwa_idx2mem(bwaidx_t *idx);
 	int bwa_mem2idx(int64_t l_mem, uint8_t *mem, bwaidx_t *idx);
@@ -79,6 +79,7 @@ mem_opt_t *mem_opt_init()
 	o->split_factor = 1.5;
 	o->chunk_size = 10000000;
 	o->n_threads = 1;
+	o->seed_batch = 1;
 	o->max_XA_hits = 5;
 	o->max_XA_hits_alt = 200;
 	o->max_matesw = 50;
@@ -90,50 +91,64 @@ mem_opt_t *mem_opt_init()
 	return o;
 }
 
+// Groups of competing frames, shared by filterCompetingAln() and worker1_frames(): runs of entries of the same read,
+// where the first entry of a batch not starting at read 0 is always kept and the last one is compared with none
+static int mem_frame_groups(const bseq1_t *seqs, int n, int *beg, int *keep_first)
+{
+	int i, m = 0, readSeq = 0, currentSeq = 0;
+	*keep_first = 0;
+	for (i = 0; i < n - 1; ++i) {
+		sscanf(seqs[i].name, "%d:", &readSeq);
+		if (i == 0 || readSeq != currentSeq) {
+			if (i == 0 && readSeq != currentSeq) *keep_first = 1;
+			beg[m++] = i;
+			currentSeq = readSeq;
+		}
+	}
+	if (n > 0) beg[m++] = n - 1;
+	beg[m] = n;
+	return m;
+}
+
+// Keep the frame with the highest total score of each group (the earliest on ties)
 void filterCompetingAln(worker_t * passWorker, int passCount, int passDisable) {
-	int seqIdx, alnIdx, bestIdx;
-	int currentSeq, readSeq;
+	int seqIdx, alnIdx, bestIdx, groupIdx, groupCount, keepFirst;
 	int seqTotal, bestTotal;
+	int * groupBeg;
 
-	currentSeq = 0;
-	bestIdx = 0;
-	bestTotal = 0;
-
-	// Iterate through each sequence and alignment
-	for (seqIdx = 0 ; seqIdx < passCount - 1 ; seqIdx++) {
-        // If filtering disabled, simply mark sequence as best
-        if (passDisable) {
-            passWorker->regs[seqIdx].active = 1;
-            continue;
-        }
-
-		// Check if we're in a new sequence or in an alternate frame
-		sscanf(passWorker->seqs[seqIdx].name, "%d:", &readSeq);
-		if (readSeq != currentSeq) {
-			// New sequence - mark best as active in previous sequence
-			passWorker->regs[bestIdx].active = 1;
-
-			// Reset search to current sequence
-			currentSeq = readSeq;
-			bestTotal = 0;
-			bestIdx = seqIdx;
-		}
+	// If filtering disabled, simply mark sequences as best
+	if (passDisable) {
+		for (seqIdx = 0 ; seqIdx < passCount - 1 ; seqIdx++) passWorker->regs[seqIdx].active = 1;
+		return;
+	}
 
-        // Aggregate all score totals for this sequence
-        seqTotal = 0;
-        for (alnIdx = 0 ; alnIdx < passWorker->regs[seqIdx].n ; alnIdx++) {
-            seqTotal += passWorker->regs[seqIdx].a[alnIdx].score;
-        }
+	groupBeg = malloc((passCount + 1) * sizeof(int));
+	groupCount = mem_frame_groups(passWorker->seqs, passCount, groupBeg, &keepFirst);
+	if (keepFirst) passWorker->regs[0].active = 1;
 
-		// Check if current alignment is best so far
-		if (seqTotal > bestTotal) {
-			bestTotal = seqTotal;
-			bestIdx = seqIdx;
+	// The trailing group holds the final entry, which only counts when alone in the batch
+	for (groupIdx = 0 ; groupIdx < groupCount && (groupIdx < groupCount - 1 || passCount == 1) ; groupIdx++) {
+		bestIdx = groupBeg[groupIdx];
+		bestTotal = 0;
+
+		for (seqIdx = groupBeg[groupIdx] ; seqIdx < groupBeg[groupIdx + 1] ; seqIdx++) {
+			// Aggregate all score totals for this sequence
+			seqTotal = 0;
+			for (alnIdx = 0 ; alnIdx < passWorker->regs[seqIdx].n ; alnIdx++) {
+				seqTotal += passWorker->regs[seqIdx].a[alnIdx].score;
+			}
+
+			// Check if current alignment is best so far
+			if (seqTotal > bestTotal) {
+				bestTotal = seqTotal;
+				bestIdx = seqIdx;
+			}
 		}
+
+		passWorker->regs[bestIdx].active = 1;
 	}
 
-	// Filter final sequence
-    if (!passDisable) passWorker->regs[bestIdx].active = 1;
+	free(groupBeg);
 }
 
 int getAlignmentType(worker_t * passWorker, int passEntry, int passAlignment) {
@@ -167,31 +182,80 @@ int getAlignmentType(worker_t * passWorker, int passEntry, int passAlignment) {
 #define intv_lt(a, b) ((a).info < (b).info)
 KSORT_INIT(mem_intv, bwtintv_t, intv_lt)
 
+static void mem_chain_tree_destroy(void *tree);
+
 static smem_aux_t *smem_aux_init()
 {
 	smem_aux_t *a;
 	a = calloc(1, sizeof(smem_aux_t));
 	a->tmpv[0] = calloc(1, sizeof(bwtintv_v));
 	a->tmpv[1] = calloc(1, sizeof(bwtintv_v));
+	a->arena = arena_init();
 	return a;
 }
 
 static void smem_aux_destroy(smem_aux_t *a)
-{	
+{
+	int i;
+
 	free(a->tmpv[0]->a); free(a->tmpv[0]);
 	free(a->tmpv[1]->a); free(a->tmpv[1]);
-	free(a->mem.a); free(a->mem1.a);
+	free(a->mem.a); free(a->mem1.a); free(a->sa.a);
+	for (i = 0; i < a->m_batch; ++i) free(a->batch[i].a);
+	free(a->batch);
+	mem_chain_tree_destroy(a->chain_tree);
+	arena_destroy(a->arena);
 	free(a);
 }
 
+// Same three passes as mem_collect_intv() on a single-strand index, with backward search only
+static void mem_collect_intv_ss(const mem_opt_t *opt, const bwt_t *bwt, int len, const uint8_t *seq, smem_aux_t *a)
+{
+	int i, k, e, old_n;
+	int start_width = (opt->flag & MEM_F_SELF_OVLP)? 2 : 1;
+	int split_len = (int)(opt->min_seed_len * opt->split_factor + .499);
+
+	// first pass: find all SMEMs
+	bwt_smem_ss(bwt, len, seq, -1, opt->min_seed_len, start_width, &a->mem);
+
+	// second pass: find MEMs inside a long SMEM
+	old_n = a->mem.n;
+	for (k = 0; k < old_n; ++k) {
+		bwtintv_t *p = &a->mem.a[k];
+		int start = p->info>>32, end = (int32_t)p->info;
+		if (end - start < split_len || p->x[2] > opt->split_width) continue;
+
+		a->mem1.n = 0;
+		bwt_smem_ss(bwt, len, seq, (start + end)>>1, opt->min_seed_len, p->x[2]+1, &a->mem1);
+		for (i = 0; i < a->mem1.n; ++i)
+			kv_push(bwtintv_t, a->mem, a->mem1.a[i]);
+	}
+
+	// third pass: LAST-like, anchored at the seed ends
+	if (opt->max_mem_intv > 0) {
+		for (e = len; e > 0; ) {
+			bwtintv_t m;
+			e = bwt_seed_strategy1_ss(bwt, seq, e, opt->min_seed_len, opt->max_mem_intv, &m);
+			if (m.x[2] > 0) kv_push(bwtintv_t, a->mem, m);
+		}
+	}
+}
+
 static void mem_collect_intv(const mem_opt_t *opt, const bwt_t *bwt, int len, const uint8_t *seq, smem_aux_t *a)
 {
 	int i, k, x = 0, old_n;
 	int start_width = (opt->flag & MEM_F_SELF_OVLP)? 2 : 1;
 	int split_len = (int)(opt->min_seed_len * opt->split_factor + .499);
 	a->mem.n = 0;
-	// first pass: find all SMEMs
-	while (x < len) {
+
+	if (opt->indexInfo.singleStrand) {
+		mem_collect_intv_ss(opt, bwt, len, seq, a);
+		ks_introsort(mem_intv, a->mem.n, a->mem.a);
+		return;
+	}
+	// first pass: find all SMEMs, unless the interleaved search already has
+	if (a->first) kv_copy(bwtintv_t, a->mem, *a->first);
+	else while (x < len) {
 		if (seq[x] < VALUE_DEFINED) {
 			x = bwt_smem1(bwt, len, seq, x, start_width, &a->mem1, a->tmpv);
 			for (i = 0; i < a->mem1.n; ++i) {
@@ -263,8 +327,14 @@ typedef struct { size_t n, m; mem_chain_t *a;  } mem_chain_v;
 #define chain_cmp(a, b) (((b).pos < (a).pos) - ((a).pos < (b).pos))
 KBTREE_INIT(chn, mem_chain_t, chain_cmp)
 
+static void mem_chain_tree_destroy(void *tree)
+{
+	kbtree_t(chn) *b = (kbtree_t(chn)*)tree;
+	if (b) kb_destroy(chn, b);
+}
+
 // return 1 if the seed is merged into the chain
-static int test_and_merge(const mem_opt_t *opt, int64_t l_pac, mem_chain_t *c, const mem_seed_t *p, int seed_rid)
+static int test_and_merge(const mem_opt_t *opt, int64_t l_pac, mem_chain_t *c, const mem_seed_t *p, int seed_rid, arena_t *km)
 {
 	int64_t qend, rend, x, y;
 	const mem_seed_t *last = &c->seeds[c->n-1];
@@ -278,8 +348,8 @@ static int test_and_merge(const mem_opt_t *opt, int64_t l_pac, mem_chain_t *c, c
 	y = p->rbeg - last->rbeg;
 	if (y >= 0 && x - y <= opt->w && y - x <= opt->w && x - last->len < opt->max_chain_gap && y - last->len < opt->max_chain_gap) { // grow the chain
 		if (c->n == c->m) {
+			c->seeds = arena_realloc(km, c->seeds, c->m * sizeof(mem_seed_t), (c->m << 1) * sizeof(mem_seed_t));
 			c->m <<= 1;
-			c->seeds = realloc(c->seeds, c->m * sizeof(mem_seed_t));
 		}
 		c->seeds[c->n++] = *p;
 		return 1;
@@ -325,19 +395,20 @@ void mem_print_chain(const bntseq_t *bns, mem_chain_v *chn)
 	}
 }
 
-mem_chain_v mem_chain(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bns, int len, const uint8_t *seq, void *buf)
+// Chains and their seeds are allocated from aux->arena
+mem_chain_v mem_chain(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bns, int len, const uint8_t *seq, smem_aux_t *aux)
 {
 	int i, b, e, l_rep;
 	int64_t l_pac = bns->l_pac;
+	size_t n_sa;
 	mem_chain_v chain;
 	kbtree_t(chn) *tree;
-	smem_aux_t *aux;
+	arena_t *km = aux->arena;
 
 	kv_init(chain);
 	if (len < opt->min_seed_len) return chain; // if the query is shorter than the seed length, no match
-	tree = kb_init(chn, KB_DEFAULT_SIZE);
-
-	aux = buf? (smem_aux_t*)buf : smem_aux_init();
+	if (aux->chain_tree == 0) aux->chain_tree = kb_init(chn, KB_DEFAULT_SIZE);
+	tree = (kbtree_t(chn)*)aux->chain_tree;
 
 	mem_collect_intv(opt, bwt, len, seq, aux);
 
@@ -349,7 +420,16 @@ mem_chain_v mem_chain(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bn
 		else e = e > se? e : se;
 	}
 	l_rep += e - b;
-	for (i = 0; i < aux->mem.n; ++i) {
+	for (i = 0, aux->sa.n = 0; i < aux->mem.n; ++i) { // collect the sampled occurrences of all seeds
+		bwtintv_t *p = &aux->mem.a[i];
+		int step, count;
+		int64_t k;
+		step = p->x[2] > opt->max_occ? p->x[2] / opt->max_occ : 1;
+		for (k = count = 0; k < p->x[2] && count < opt->max_occ; k += step, ++count)
+			kv_push(bwtint_t, aux->sa, p->x[0] + k);
+	}
+	bwt_sa_batch(bwt, aux->sa.n, aux->sa.a, aux->sa.a);
+	for (i = 0, n_sa = 0; i < aux->mem.n; ++i) {
 		bwtintv_t *p = &aux->mem.a[i];
 		int step, count, slen = (uint32_t)p->info - (p->info>>32); // seed length
 		int64_t k;
@@ -358,18 +438,18 @@ mem_chain_v mem_chain(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bn
 			mem_chain_t tmp, *lower, *upper;
 			mem_seed_t s;
 			int rid, to_add = 0;
-			s.rbeg = tmp.pos = bwt_sa(bwt, p->x[0] + k); // this is the base coordinate in the forward-reverse reference
+			s.rbeg = tmp.pos = aux->sa.a[n_sa++]; // this is the base coordinate in the forward-reverse reference
 			s.qbeg = p->info>>32;
 			s.score= s.len = slen;
 			rid = bns_intv2rid(bns, s.rbeg, s.rbeg + s.len);
 			if (rid < 0) continue; // bridging multiple reference sequences or the forward-reverse boundary; TODO: split the seed; don't discard it!!!
 			if (kb_size(tree)) {
 				kb_intervalp(chn, tree, &tmp, &lower, &upper); // find the closest chain
-				if (!lower || !test_and_merge(opt, l_pac, lower, &s, rid)) to_add = 1;
+				if (!lower || !test_and_merge(opt, l_pac, lower, &s, rid, km)) to_add = 1;
 			} else to_add = 1;
 			if (to_add) { // add the seed as a new chain
 				tmp.n = 1; tmp.m = 4;
-				tmp.seeds = calloc(tmp.m, sizeof(mem_seed_t));
+				tmp.seeds = arena_calloc(km, tmp.m, sizeof(mem_seed_t));
 				tmp.seeds[0] = s;
 				tmp.rid = rid;
 				tmp.is_alt = !!bns->anns[rid].is_alt;
@@ -377,18 +457,25 @@ mem_chain_v mem_chain(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bn
 			}
 		}
 	}
-	if (buf == 0) smem_aux_destroy(aux);
-
-	kv_resize(mem_chain_t, chain, kb_size(tree));
-
-	#define traverse_func(p_) (chain.a[chain.n++] = *(p_))
-	__kb_traverse(mem_chain_t, tree, traverse_func);
-	#undef traverse_func
+	chain.m = kb_size(tree);
+	chain.a = arena_alloc(km, chain.m * sizeof(mem_chain_t));
+
+	if (tree->root->is_internal) { // more chains than a node holds; walk the tree and drop it
+		#define traverse_func(p_) (chain.a[chain.n++] = *(p_))
+		__kb_traverse(mem_chain_t, tree, traverse_func);
+		#undef traverse_func
+		kb_destroy(chn, tree);
+		aux->chain_tree = 0;
+	} else { // a single leaf holds the chains in order; empty it for the next ORF
+		chain.n = tree->root->n;
+		memcpy(chain.a, __KB_KEY(mem_chain_t, tree->root), chain.n * sizeof(mem_chain_t));
+		tree->root->n = 0;
+		tree->n_keys = 0;
+	}
 
 	for (i = 0; i < chain.n; ++i) chain.a[i].frac_rep = (float)l_rep / len;
 	logMessage(__func__, LOG_LEVEL_DEBUG, "* fraction of repetitive seeds: %.3f\n", (float)l_rep / len);
 
-	kb_destroy(chn, tree);
 	return chain;
 }
 
@@ -402,17 +489,19 @@ mem_chain_v mem_chain(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bn
 #define flt_lt(a, b) ((a).w > (b).w)
 KSORT_INIT(mem_flt, mem_chain_t, flt_lt)
 
-int mem_chain_flt(const mem_opt_t *opt, int n_chn, mem_chain_t *a)
+int mem_chain_flt(const mem_opt_t *opt, int n_chn, mem_chain_t *a, arena_t *km)
 {
 	int i, k;
 	kvec_t(int) chains = {0,0,0}; // this keeps int indices of the non-overlapping chains
 	if (n_chn == 0) return 0; // no need to filter
+	chains.m = n_chn; // never outgrown, so kv_push() below does not reallocate
+	chains.a = arena_alloc(km, chains.m * sizeof(int));
 	// compute the weight of each chain and drop chains with small weight
 	for (i = k = 0; i < n_chn; ++i) {
 		mem_chain_t *c = &a[i];
 		c->first = -1; c->kept = 0;
 		c->w = mem_chain_weight(c);
-		if (c->w < opt->min_chain_weight) free(c->seeds);
+		if (c->w < opt->min_chain_weight) arena_free(km, c->seeds);
 		else a[k++] = *c;
 	}
 	n_chn = k;
@@ -447,7 +536,7 @@ int mem_chain_flt(const mem_opt_t *opt, int n_chn, mem_chain_t *a)
 		mem_chain_t *c = &a[chains.a[i]];
 		if (c->first >= 0) a[c->first].kept = 1;
 	}
-	free(chains.a);
+	arena_free(km, chains.a);
 	for (i = k = 0; i < n_chn; ++i) { // don't extend more than opt->max_chain_extend .kept=1/2 chains
 		if (a[i].kept == 0 || a[i].kept == 3) continue;
 		if (++k >= opt->max_chain_extend) break;
@@ -456,7 +545,7 @@ int mem_chain_flt(const mem_opt_t *opt, int n_chn, mem_chain_t *a)
 		if (a[i].kept < 3) a[i].kept = 0;
 	for (i = k = 0; i < n_chn; ++i) { // free discarded chains
 		mem_chain_t *c = &a[i];
-		if (c->kept == 0) free(c->seeds);
+		if (c->kept == 0) arena_free(km, c->seeds);
 		else a[k++] = a[i];
 	}
 	return k;
@@ -503,7 +592,7 @@ int mem_patch_reg(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
 	w += a->w + b->w;
 	w = w < opt->w<<2? w : opt->w<<2;
 	if (bwa_verbose >= 4) printf("* test potential hit merge with global alignment; w=%d\n", w);
-	bwa_gen_cigar2(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, w, bns->l_pac, pac, b->qe - a->qb, query + a->qb, a->rb, b->re, &score, 0, 0);
+	bwa_gen_cigar2(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, w, bns, pac, b->qe - a->qb, query + a->qb, a->rb, b->re, &score, 0, 0);
 	q_s = (int)((double)(b->qe - a->qb) / ((b->qe - b->qb) + (a->qe - a->qb)) * (b->score + a->score) + .499); // predicted score from query
 	r_s = (int)((double)(b->re - a->rb) / ((b->re - b->rb) + (a->re - a->rb)) * (b->score + a->score) + .499); // predicted score from ref
 	if (bwa_verbose >= 4) printf("* score=%d;(%d,%d)\n", score, q_s, r_s);
@@ -653,7 +742,7 @@ int mem_mark_primary_se(const mem_opt_t *opt, int n, mem_alnreg_t *a, int64_t id
 #define MEM_MINSC_COEF 5.5f
 #define MEM_SEEDSW_COEF 0.05f
 
-int mem_seed_sw(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const uint8_t *query, const mem_seed_t *s)
+int mem_seed_sw(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const uint8_t *query, const mem_seed_t *s, arena_t *km)
 {
 	int qb, qe, rid;
 	int64_t rb, re, mid, l_pac = bns->l_pac;
@@ -674,13 +763,13 @@ int mem_seed_sw(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, i
 	}
 	if (qe - qb >= MEM_SHORT_LEN || re - rb >= MEM_SHORT_LEN) return -1; // the seed seems good enough; no need to do SW
 
-	rseq = bns_fetch_seq(bns, pac, &rb, mid, &re, &rid);
+	rseq = bns_fetch_seq2(bns, pac, &rb, mid, &re, &rid, arena_alloc(km, re - rb));
 	x = ksw_align2(qe - qb, (uint8_t*)query + qb, re - rb, rseq, VALUE_DEFINED, opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, KSW_XSTART, 0);
-	free(rseq);
+	arena_free(km, rseq);
 	return x.score;
 }
 
-void mem_flt_chained_seeds(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const uint8_t *query, int n_chn, mem_chain_t *a)
+void mem_flt_chained_seeds(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const uint8_t *query, int n_chn, mem_chain_t *a, arena_t *km)
 {
 	double min_l = opt->min_chain_weight? MEM_HSP_COEF * opt->min_chain_weight : MEM_MINSC_COEF * log(l_query);
 	int i, j, k, min_HSP_score = (int)(opt->a * min_l + .499);
@@ -689,7 +778,7 @@ void mem_flt_chained_seeds(const mem_opt_t *opt, const bntseq_t *bns, const uint
 		mem_chain_t *c = &a[i];
 		for (j = k = 0; j < c->n; ++j) {
 			mem_seed_t *s = &c->seeds[j];
-			s->score = mem_seed_sw(opt, bns, pac, l_query, query, s);
+			s->score = mem_seed_sw(opt, bns, pac, l_query, query, s, km);
 			if (s->score < 0 || s->score >= min_HSP_score) {
 				s->score = s->score < 0? s->len * opt->a : s->score;
 				c->seeds[k++] = *s;
@@ -714,15 +803,118 @@ static inline int cal_max_gap(const mem_opt_t *opt, int qlen)
 
 #define MAX_BAND_TRY  2
 
-void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const uint8_t *query, const mem_chain_t *c, mem_alnreg_v *av)
+static inline void mem_ext_count(mem_extstat_t *st, int try_i, int score, int cells)
+{
+	++st->n, st->cells += cells;
+	if (try_i > 0) ++st->n_wide, st->cells_wide += cells;
+	if (score == KSW_EXT_WIDER) ++st->n_given_up;
+}
+
+// Best score among the hits that overlap hit p significantly on the query, like those mem_mark_primary_se() takes
+// its sub-optimal score from
+static int mem_sub_score(const mem_opt_t *opt, const mem_alnreg_v *av, const mem_alnreg_t *p)
+{
+	int i, sub = 0;
+	for (i = 0; i < av->n; ++i) {
+		const mem_alnreg_t *q = &av->a[i];
+		int b_max = p->qb > q->qb? p->qb : q->qb;
+		int e_min = p->qe < q->qe? p->qe : q->qe;
+		int min_l = p->qe - p->qb < q->qe - q->qb? p->qe - p->qb : q->qe - q->qb;
+		if (q != p && e_min > b_max && e_min - b_max >= min_l * opt->mask_level && q->score > sub) sub = q->score;
+	}
+	return sub;
+}
+
+// Fraction of the best hit below which a secondary is neither reported nor listed in the XA tag
+static inline float mem_skip_ratio(const mem_opt_t *opt)
+{
+	return opt->drop_ratio < opt->XA_drop_ratio? opt->drop_ratio : opt->XA_drop_ratio;
+}
+
+// Residues an extension from seed s can add on its left (*l) and right (*r): as many as both the query and the
+// reference sequence leave on that side of the seed
+static void mem_seed_reach(const bntseq_t *bns, int l_query, const mem_seed_t *s, int rid, int *l, int *r)
+{
+	int64_t beg, end, tmp;
+	beg = bns->anns[rid].offset, end = beg + bns->anns[rid].len;
+	if (s->rbeg >= bns->l_pac) // on the reverse strand
+		tmp = beg, beg = (bns->l_pac<<1) - end, end = (bns->l_pac<<1) - tmp;
+	*l = s->rbeg - beg < s->qbeg? s->rbeg - beg : s->qbeg;
+	*r = end - (s->rbeg + s->len) < l_query - (s->qbeg + s->len)? end - (s->rbeg + s->len) : l_query - (s->qbeg + s->len);
+}
+
+// Most an extension from seed s can score: every residue within mem_seed_reach() matched at opt->a
+static int mem_seed_max(const mem_opt_t *opt, const bntseq_t *bns, int l_query, const mem_seed_t *s, int rid)
+{
+	int l, r;
+	mem_seed_reach(bns, l_query, s, rid, &l, &r);
+	return (l + s->len + r) * opt->a;
+}
+
+// Whether an extension from seed s is bound to add a secondary of the best hit p so far that is never reported and
+// does not change the sub-optimal score of p: the seed lies within p on the query, and even at mem_seed_max() the
+// hit would score below drop_ratio of p and no higher than the hits overlapping p already do. Secondaries above
+// XA_drop_ratio of p still go to the XA tag, so the lower of the two ratios applies. The hit only becomes a
+// secondary of p if mem_mark_primary_se() finds their overlap significant wherever the extension ends. Within
+// mem_seed_reach(), the hit overlaps p least when it starts at the seed and runs as far past p->qe as it can, or
+// ends at the seed and starts as far before p->qb as it can
+static int mem_seed_hopeless(const mem_opt_t *opt, const bntseq_t *bns, int l_query, const mem_seed_t *s, int rid, const mem_alnreg_t *p, int sub)
+{
+	int l, r, qb, qe, max, p_len;
+	if (p == 0 || s->qbeg < p->qb || s->qbeg + s->len > p->qe) return 0;
+	mem_seed_reach(bns, l_query, s, rid, &l, &r);
+	qb = s->qbeg - l, qe = s->qbeg + s->len + r, p_len = p->qe - p->qb;
+	if (qe > p->qe && p->qe - s->qbeg < (qe - s->qbeg < p_len? qe - s->qbeg : p_len) * opt->mask_level) return 0;
+	if (qb < p->qb && s->qbeg + s->len - p->qb < (s->qbeg + s->len - qb < p_len? s->qbeg + s->len - qb : p_len) * opt->mask_level) return 0;
+	max = (l + s->len + r) * opt->a;
+	return max < p->score * mem_skip_ratio(opt) && max <= sub;
+}
+
+// Most the hits extended from these chains can add up to, as filterCompetingAln() sums them. A hit scores at most
+// mem_seed_max() of its seed, unless mem_sort_dedup_patch() merges hits on the same reference sequence: the merged
+// one covers at most the query or that sequence, and stands for two seeds or more
+static int64_t mem_chains_max(const mem_opt_t *opt, const bntseq_t *bns, int l_query, const mem_chain_v *chn)
 {
-	int i, k, rid, max_off[2], aw[2]; // aw: actual bandwidth used in extension
+	int i, j, k, alone, half, sc;
+	int64_t max = 0;
+	for (i = 0; i < chn->n; ++i) {
+		const mem_chain_t *c = &chn->a[i];
+		for (j = 0, alone = c->n == 1; j < chn->n && alone; ++j)
+			if (j != i && chn->a[j].rid == c->rid) alone = 0;
+		half = ((l_query < bns->anns[c->rid].len? l_query : bns->anns[c->rid].len) * opt->a + 1) >> 1;
+		for (k = 0; k < c->n; ++k) {
+			sc = mem_seed_max(opt, bns, l_query, &c->seeds[k], c->rid);
+			max += alone || sc >= half? sc : half;
+		}
+	}
+	return max;
+}
+
+// A try gives up as soon as its drift makes the next, wider try certain. Only the try before the last does:
+// an earlier one would leave the next without the score it is compared with
+#define band_give_up(i, w) ((i) + 2 == MAX_BAND_TRY? ((w)>>1) + ((w)>>2) : INT_MAX)
+
+void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const uint8_t *query, const mem_chain_t *c, mem_alnreg_v *av, smem_aux_t *aux)
+{
+	int i, k, rid, max_off[2], aw[2], cells, best = -1, sub = 0, lazy = !(opt->flag & MEM_F_ALL); // aw: actual bandwidth used in extension
 	int64_t l_pac = bns->l_pac, rmax[2], tmp, max = 0;
+	arena_t *km = aux->arena;
 	const mem_seed_t *s;
 	uint8_t *rseq = 0;
 	uint64_t *srt;
 
 	if (c->n == 0) return;
+	if (lazy) { // chains come by decreasing weight; skip one whose seeds are all hopeless
+		for (i = 0; i < av->n; ++i)
+			if (best < 0 || av->a[i].score > av->a[best].score) best = i;
+		if (best >= 0) sub = mem_sub_score(opt, av, &av->a[best]);
+		for (i = 0; i < c->n; ++i)
+			if (!mem_seed_hopeless(opt, bns, l_query, &c->seeds[i], c->rid, best < 0? 0 : &av->a[best], sub)) break;
+		if (i == c->n) {
+			++aux->ext.n_chain_skipped;
+			return;
+		}
+	}
 	// get the max possible span
 	rmax[0] = l_pac<<1; rmax[1] = 0;
 	for (i = 0; i < c->n; ++i) {
@@ -741,10 +933,10 @@ void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac
 		else rmax[0] = l_pac;
 	}
 	// retrieve the reference sequence
-	rseq = bns_fetch_seq(bns, pac, &rmax[0], c->seeds[0].rbeg, &rmax[1], &rid);
+	rseq = bns_fetch_seq2(bns, pac, &rmax[0], c->seeds[0].rbeg, &rmax[1], &rid, arena_alloc(km, rmax[1] - rmax[0]));
 	assert(c->rid == rid);
 
-	srt = malloc(c->n * 8);
+	srt = arena_alloc(km, c->n * 8);
 	for (i = 0; i < c->n; ++i)
 		srt[i] = (uint64_t)c->seeds[i].score<<32 | i;
 	ks_introsort_64(c->n, srt);
@@ -752,6 +944,11 @@ void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac
 	for (k = c->n - 1; k >= 0; --k) {
 		mem_alnreg_t *a;
 		s = &c->seeds[(uint32_t)srt[k]];
+		if (best >= 0 && mem_seed_hopeless(opt, bns, l_query, s, c->rid, &av->a[best], sub)) {
+			++aux->ext.n_seed_skipped;
+			srt[k] = 0;
+			continue;
+		}
 
 		for (i = 0; i < av->n; ++i) { // test whether extension has been made before
 			mem_alnreg_t *p = &av->a[i];
@@ -797,24 +994,21 @@ void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac
 		a->rid = c->rid;
 
 		if (bwa_verbose >= 4) err_printf("** ---> Extending from seed(%d) [%ld;%ld,%ld] @ %s <---\n", k, (long)s->len, (long)s->qbeg, (long)s->rbeg, bns->anns[c->rid].name);
-		if (s->qbeg) { // left extension
-			uint8_t *rs, *qs;
+		if (s->qbeg) { // left extension, reading the query and the reference window before the seed backwards in place
 			int qle, tle, gtle, gscore;
-			qs = malloc(s->qbeg);
-			for (i = 0; i < s->qbeg; ++i) qs[i] = query[s->qbeg - 1 - i];
 			tmp = s->rbeg - rmax[0];
-			rs = malloc(tmp);
-			for (i = 0; i < tmp; ++i) rs[i] = rseq[tmp - 1 - i];
 			for (i = 0; i < MAX_BAND_TRY; ++i) {
 				int prev = a->score;
 				aw[0] = opt->w << i;
 				if (bwa_verbose >= 4) {
 					int j;
-					printf("*** Left ref:   "); for (j = 0; j < tmp; ++j) putchar("ACGTN"[(int)rs[j]]); putchar('\n');
-					printf("*** Left query: "); for (j = 0; j < s->qbeg; ++j) putchar("ACGTN"[(int)qs[j]]); putchar('\n');
+					printf("*** Left ref:   "); for (j = 0; j < tmp; ++j) putchar("ACGTN"[(int)rseq[tmp - 1 - j]]); putchar('\n');
+					printf("*** Left query: "); for (j = 0; j < s->qbeg; ++j) putchar("ACGTN"[(int)query[s->qbeg - 1 - j]]); putchar('\n');
 				}
-				a->score = ksw_extend2(s->qbeg, qs, tmp, rs, VALUE_DEFINED, opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, aw[0], opt->pen_clip5, opt->zdrop, s->len * opt->a, &qle, &tle, &gtle, &gscore, &max_off[0]);
+				a->score = ksw_extend2_try(s->qbeg, query, tmp, rseq, 1, VALUE_DEFINED, opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, aw[0], opt->pen_clip5, opt->zdrop, s->len * opt->a, band_give_up(i, aw[0]), prev, &qle, &tle, &gtle, &gscore, &max_off[0], &cells);
+				mem_ext_count(&aux->ext, i, a->score, cells);
 				if (bwa_verbose >= 4) { printf("*** Left extension: prev_score=%d; score=%d; bandwidth=%d; max_off_diagonal_dist=%d\n", prev, a->score, aw[0], max_off[0]); fflush(stdout); }
+				if (a->score == KSW_EXT_WIDER) continue;
 				if (a->score == prev || max_off[0] < (aw[0]>>1) + (aw[0]>>2)) break;
 			}
 			// check whether we prefer to reach the end of the query
@@ -825,7 +1019,6 @@ void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac
 				a->qb = 0, a->rb = s->rbeg - gtle;
 				a->truesc = gscore;
 			}
-			free(qs); free(rs);
 		} else a->score = a->truesc = s->len * opt->a, a->qb = 0, a->rb = s->rbeg;
 
 		if (s->qbeg + s->len != l_query) { // right extension
@@ -842,8 +1035,10 @@ void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac
 					printf("*** Right query: "); for (j = 0; j < l_query - qe; ++j) putchar("ACGTN"[(int)query[qe+j]]); putchar('\n');
 				}
 
-				a->score = ksw_extend2(l_query - qe, query + qe, rmax[1] - rmax[0] - re, rseq + re, VALUE_DEFINED, opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, aw[1], opt->pen_clip3, opt->zdrop, sc0, &qle, &tle, &gtle, &gscore, &max_off[1]);
+				a->score = ksw_extend2_try(l_query - qe, query + qe, rmax[1] - rmax[0] - re, rseq + re, 0, VALUE_DEFINED, opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, aw[1], opt->pen_clip3, opt->zdrop, sc0, band_give_up(i, aw[1]), prev, &qle, &tle, &gtle, &gscore, &max_off[1], &cells);
+				mem_ext_count(&aux->ext, i, a->score, cells);
 				if (bwa_verbose >= 4) { printf("*** Right extension: prev_score=%d; score=%d; bandwidth=%d; max_off_diagonal_dist=%d\n", prev, a->score, aw[1], max_off[1]); fflush(stdout); }
+				if (a->score == KSW_EXT_WIDER) continue;
 				if (a->score == prev || max_off[1] < (aw[1]>>1) + (aw[1]>>2)) break;
 			}
 			// similar to the above
@@ -867,8 +1062,12 @@ void mem_chain2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac
 		a->seedlen0 = s->len;
 
 		a->frac_rep = c->frac_rep;
+		if (lazy) { // keep the best hit and its sub-optimal score up to date
+			if (best < 0 || a->score > av->a[best].score) best = a - av->a;
+			sub = mem_sub_score(opt, av, &av->a[best]);
+		}
 	}
-	free(srt); free(rseq);
+	arena_free(km, srt); arena_free(km, rseq);
 }
 
 /*****************************
@@ -1057,8 +1256,32 @@ int mem_approx_mapq_se(const mem_opt_t *opt, const mem_alnreg_t *a)
 	return mapq;
 }
 
+// Whether mem_reg2sam() writes hit p, which gets a CIGAR
+static inline int mem_reg_reported(const mem_opt_t *opt, const mem_alnreg_v *a, const mem_alnreg_t *p)
+{
+	if (p->score < opt->T) return 0;
+	if (p->secondary >= 0 && (p->is_alt || !(opt->flag&MEM_F_ALL))) return 0;
+	if (p->secondary >= 0 && p->secondary < INT_MAX && p->score < a->a[p->secondary].score * opt->drop_ratio) return 0;
+	return 1;
+}
+
+// Cache the mapq mem_reg2sam() gives each reported hit, without generating its alignment; returns the number of hits
+static int mem_reg2mapq(const mem_opt_t *opt, mem_alnreg_v *a)
+{
+	int k, l, mapq0 = 0;
+	for (k = l = 0; k < a->n; ++k) {
+		mem_alnreg_t *p = &a->a[k];
+		if (!mem_reg_reported(opt, a, p)) continue;
+		p->mapq = p->secondary < 0? mem_approx_mapq_se(opt, p) : 0;
+		if (l && !p->is_alt && p->mapq > mapq0) p->mapq = mapq0; // as supplementary hits in mem_reg2sam()
+		if (l++ == 0) mapq0 = p->mapq;
+	}
+	return l;
+}
+
+// Returns the number of hits given a CIGAR, none for an ORF that lost frame filtering
 // TODO (future plan): group hits into a uint64_t[] array. This will be cleaner and more flexible
-void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, bseq1_t *s, mem_alnreg_v *a, int extra_flag, const mem_aln_t *m)
+int mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, bseq1_t *s, mem_alnreg_v *a, int extra_flag, const mem_aln_t *m)
 {
 	extern char **mem_gen_alt(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, mem_alnreg_v *a, int l_query, const char *query);
 	kstring_t str;
@@ -1066,6 +1289,11 @@ void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
 	int k, l;
 	char **XA = 0;
 
+	if (!(a->active)) { // frame filtered out: addUniprotList() skips it, so neither SAM nor mapq is needed
+		s->sam = 0;
+		return 0;
+	}
+
 	if (!(opt->flag & MEM_F_ALL))
 		XA = mem_gen_alt(opt, bns, pac, a, s->l_seq, s->seq);
 	kv_init(aa);
@@ -1075,9 +1303,7 @@ void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
 		mem_alnreg_t *p = &a->a[k];
 		mem_aln_t *q;
 
-		if (p->score < opt->T) continue;
-		if (p->secondary >= 0 && (p->is_alt || !(opt->flag&MEM_F_ALL))) continue;
-		if (p->secondary >= 0 && p->secondary < INT_MAX && p->score < a->a[p->secondary].score * opt->drop_ratio) continue;
+		if (!mem_reg_reported(opt, a, p)) continue;
 
 		q = kv_pushp(mem_aln_t, aa);
 		*q = mem_reg2aln(opt, bns, pac, s->l_seq, s->seq, p);
@@ -1094,12 +1320,7 @@ void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
 		++l;
 	}
 
-	// Skip alignments filtered by competing frames
-	if (!(a->active)) {
-		for (k = 0; k < aa.n; ++k) free(aa.a[k].cigar);
-		if (aa.n > 0) free(aa.a);
-	}
-	else if (aa.n == 0) { // no alignments good enough; then write an unaligned record
+	if (aa.n == 0) { // no alignments good enough; then write an unaligned record
 		mem_aln_t t;
 		t = mem_reg2aln(opt, bns, pac, s->l_seq, s->seq, 0);
 		t.flag |= extra_flag;
@@ -1116,32 +1337,40 @@ void mem_reg2sam(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac,
 		for (k = 0; k < a->n; ++k) free(XA[k]);
 		free(XA);
 	}
+	return l;
 }
 
-mem_alnreg_v mem_align1_core(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bns, const uint8_t *pac, int l_seq, char *seq, void *buf)
+// Seed and chain one ORF, encoding it in place. The chains are left in aux->arena until it is reset
+static mem_chain_v mem_align1_chain(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bns, const uint8_t *pac, int l_seq, char *seq, smem_aux_t *aux)
 {
 	int i;
 	mem_chain_v chn;
-	mem_alnreg_v regs;
 
 	for (i = 0; i < l_seq; ++i) {
 		// Hash IUPAC value
 		seq[i] = seq[i] < VALUE_DEFINED - 1 ? seq[i] : aa_encode_hash[(int)seq[i]];
 	}
 
-	chn = mem_chain(opt, bwt, bns, l_seq, (uint8_t*)seq, buf);
-	chn.n = mem_chain_flt(opt, chn.n, chn.a);
-	mem_flt_chained_seeds(opt, bns, pac, l_seq, (uint8_t*)seq, chn.n, chn.a);
+	chn = mem_chain(opt, bwt, bns, l_seq, (uint8_t*)seq, aux);
+	chn.n = mem_chain_flt(opt, chn.n, chn.a, aux->arena);
+	mem_flt_chained_seeds(opt, bns, pac, l_seq, (uint8_t*)seq, chn.n, chn.a, aux->arena);
 	if (bwa_verbose >= 4) mem_print_chain(bns, &chn);
+	return chn;
+}
+
+static mem_alnreg_v mem_align1_extend(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_seq, char *seq, mem_chain_v *chn, smem_aux_t *aux)
+{
+	int i;
+	mem_alnreg_v regs;
 
 	kv_init(regs);
-	for (i = 0; i < chn.n; ++i) {
-		mem_chain_t *p = &chn.a[i];
+	for (i = 0; i < chn->n; ++i) {
+		mem_chain_t *p = &chn->a[i];
 		if (bwa_verbose >= 4) err_printf("* ---> Processing chain(%d) <---\n", i);
-		mem_chain2aln(opt, bns, pac, l_seq, (uint8_t*)seq, p, &regs);
-		free(chn.a[i].seeds);
+		mem_chain2aln(opt, bns, pac, l_seq, (uint8_t*)seq, p, &regs, aux);
+		arena_free(aux->arena, chn->a[i].seeds);
 	}
-	free(chn.a);
+	arena_free(aux->arena, chn->a);
 	regs.n = mem_sort_dedup_patch(opt, bns, pac, (uint8_t*)seq, regs.n, regs.a);
 	if (opt->flag & MEM_F_SELF_OVLP)
 		regs.n = mem_test_and_remove_exact(opt, regs.n, regs.a, l_seq);
@@ -1162,7 +1391,19 @@ mem_alnreg_v mem_align1_core(const mem_opt_t *opt, const bwt_t *bwt, const bntse
 	regs.active = 0;
 
 	return regs;
+}
+
+mem_alnreg_v mem_align1_core(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bns, const uint8_t *pac, int l_seq, char *seq, void *buf)
+{
+	mem_chain_v chn;
+	mem_alnreg_v regs;
+	smem_aux_t *aux = buf? (smem_aux_t*)buf : smem_aux_init();
 
+	chn = mem_align1_chain(opt, bwt, bns, pac, l_seq, seq, aux);
+	regs = mem_align1_extend(opt, bns, pac, l_seq, seq, &chn, aux);
+	arena_reset(aux->arena); // the regions kept in regs are on the heap
+	if (buf == 0) smem_aux_destroy(aux);
+	return regs;
 }
 
 mem_aln_t mem_reg2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, int l_query, const char *query_, const mem_alnreg_t *ar)
@@ -1196,7 +1437,7 @@ mem_aln_t mem_reg2aln(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *
 	do {
 		free(a.cigar);
 		w2 = w2 < opt->w<<2? w2 : opt->w<<2;
-		a.cigar = bwa_gen_cigar2(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, w2, bns->l_pac, pac, qe - qb, (uint8_t*)&query[qb], rb, re, &score, &a.n_cigar, &NM);
+		a.cigar = bwa_gen_cigar2(opt->mat, opt->o_del, opt->e_del, opt->o_ins, opt->e_ins, w2, bns, pac, qe - qb, (uint8_t*)&query[qb], rb, re, &score, &a.n_cigar, &NM);
 		if (bwa_verbose >= 4) printf("* Final alignment: w2=%d, global_sc=%d, local_sc=%d\n", w2, score, ar->truesc);
 		if (score == last_sc || w2 == opt->w<<2) break; // it is possible that global alignment and local alignment give different scores
 		last_sc = score;
@@ -1256,6 +1497,97 @@ static void worker1(void *data, int i, int tid)
 	}
 }
 
+// Seed seed_batch entries together with bwt_smem1_batch(), then align each read with its first pass done
+static void worker1_batch(void *data, int b, int tid)
+{
+	worker_t *w = (worker_t*)data;
+	smem_aux_t *aux = w->aux[tid];
+	uint8_t *buf, **q;
+	int i, j, beg, end, n, *len, pe = !!(w->opt->flag&MEM_F_PE);
+	int64_t l_buf;
+
+	beg = b * w->opt->seed_batch;
+	end = beg + w->opt->seed_batch < w->n? beg + w->opt->seed_batch : w->n;
+	beg <<= pe; end <<= pe;
+	n = end - beg;
+
+	if (aux->m_batch < n) {
+		aux->batch = realloc(aux->batch, n * sizeof(bwtintv_v));
+		memset(aux->batch + aux->m_batch, 0, (n - aux->m_batch) * sizeof(bwtintv_v));
+		aux->m_batch = n;
+	}
+
+	// Encoded copies, as mem_align1_core() encodes the reads themselves
+	q = malloc(n * sizeof(uint8_t*));
+	len = malloc(n * sizeof(int));
+	for (i = 0, l_buf = 0; i < n; ++i) l_buf += w->seqs[beg + i].l_seq;
+	buf = malloc(l_buf + 1);
+	for (i = 0, l_buf = 0; i < n; ++i) {
+		const char *seq = w->seqs[beg + i].seq;
+		q[i] = buf + l_buf;
+		len[i] = w->seqs[beg + i].l_seq;
+		for (j = 0; j < len[i]; ++j) q[i][j] = seq[j] < VALUE_DEFINED - 1 ? seq[j] : aa_encode_hash[(int)seq[j]];
+		l_buf += len[i];
+		if (len[i] < w->opt->min_seed_len) len[i] = 0; // never seeded, see mem_chain()
+		aux->batch[i].n = 0;
+	}
+	bwt_smem1_batch(w->bwt, n, len, (const uint8_t *const *)q, (w->opt->flag & MEM_F_SELF_OVLP)? 2 : 1, w->opt->min_seed_len, aux->batch);
+	free(buf); free(q); free(len);
+
+	for (i = beg; i < end; ++i) {
+		if (bwa_verbose >= 4) printf("=====> Processing read '%s' <=====\n", w->seqs[i].name);
+		aux->first = &aux->batch[i - beg];
+		w->regs[i] = mem_align1_core(w->opt, w->bwt, w->bns, w->pac, w->seqs[i].l_seq, w->seqs[i].seq, aux);
+	}
+	aux->first = 0;
+}
+
+// Align the competing frames of one read by decreasing bound on their summed score. A frame that cannot outscore
+// the best one extended so far, with ties going to the earlier entry as in filterCompetingAln(), is never chosen,
+// and neither is any frame after it: their chains are dropped unextended and they are left without hits
+static void worker1_frames(void *data, int g, int tid)
+{
+	worker_t *w = (worker_t*)data;
+	smem_aux_t *aux = w->aux[tid];
+	int beg = w->frames[g], n = w->frames[g+1] - beg, i, j, k, best = -1, total, best_total = 0;
+	mem_chain_v *chn;
+	uint64_t *srt;
+
+	chn = arena_alloc(aux->arena, n * sizeof(mem_chain_v));
+	srt = arena_alloc(aux->arena, n * 8);
+	for (k = 0; k < n; ++k) {
+		int64_t max;
+		if (bwa_verbose >= 4) printf("=====> Processing read '%s' <=====\n", w->seqs[beg + k].name);
+		chn[k] = mem_align1_chain(w->opt, w->bwt, w->bns, w->pac, w->seqs[beg + k].l_seq, w->seqs[beg + k].seq, aux);
+		max = mem_chains_max(w->opt, w->bns, w->seqs[beg + k].l_seq, &chn[k]);
+		srt[k] = (uint64_t)(max < INT_MAX? max : INT_MAX)<<32 | (uint32_t)(n - 1 - k); // earlier entries first on ties
+	}
+	ks_introsort_64(n, srt);
+	for (k = n - 1; k >= 0; --k) {
+		int max = srt[k]>>32;
+		i = n - 1 - (uint32_t)srt[k];
+		if (best >= 0 && (max < best_total || (max == best_total && i > best)) && !(beg + i == 0 && w->keep_first)) {
+			if (chn[i].n > 0) ++aux->ext.n_frame_skipped;
+			memset(&w->regs[beg + i], 0, sizeof(mem_alnreg_v));
+			continue;
+		}
+		w->regs[beg + i] = mem_align1_extend(w->opt, w->bns, w->pac, w->seqs[beg + i].l_seq, w->seqs[beg + i].seq, &chn[i], aux);
+		for (j = 0, total = 0; j < w->regs[beg + i].n; ++j)
+			total += w->regs[beg + i].a[j].score;
+		if (best < 0 || total > best_total || (total == best_total && i < best)) best = i, best_total = total;
+	}
+	arena_reset(aux->arena);
+}
+
+// Report-only counterpart of worker2(): hits get the primary marks and mapq of the UniProt report, but no SAM record
+static void worker2_report(void *data, int i, int tid)
+{
+	worker_t *w = (worker_t*)data;
+	mem_mark_primary_se(w->opt, w->regs[i].n, w->regs[i].a, w->n_processed + i);
+	if (w->regs[i].active) mem_reg2mapq(w->opt, &w->regs[i]); // filtered frames are skipped by addUniprotList()
+	w->seqs[i].sam = 0;
+}
+
 static void worker2(void *data, int i, int tid)
 {
 	extern int mem_sam_pe(const mem_opt_t *opt, const bntseq_t *bns, const uint8_t *pac, const mem_pestat_t pes[4], uint64_t id, bseq1_t s[2], mem_alnreg_v a[2]);
@@ -1266,8 +1598,10 @@ static void worker2(void *data, int i, int tid)
 		if (w->opt->flag & MEM_F_ALN_REG) {
 			mem_reg2ovlp(w->opt, w->bns, w->pac, &w->seqs[i], &w->regs[i]);
 		} else {
+			mem_extstat_t *st = &w->aux[tid]->ext;
 			mem_mark_primary_se(w->opt, w->regs[i].n, w->regs[i].a, w->n_processed + i);
-			mem_reg2sam(w->opt, w->bns, w->pac, &w->seqs[i], &w->regs[i], 0, 0);
+			st->n_cigar += mem_reg2sam(w->opt, w->bns, w->pac, &w->seqs[i], &w->regs[i], 0, 0);
+			if (!w->regs[i].active) st->n_cigar_skipped += w->regs[i].n;
 		}
 
 		//free(w->regs[i].a);
@@ -1283,8 +1617,12 @@ void mem_process_seqs(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bn
 	extern void kt_for(int n_threads, void (*func)(void*,int,int), void *data, int n);
 	worker_t w;
 	mem_pestat_t pes[VALUE_DOMAIN];
-	double ctime, rtime;
+	mem_extstat_t ext;
+	double ctime, rtime, rtime1;
 	int i;
+#if defined(USE_MALLOC_WRAPPERS) && defined(PALADIN_ALLOC_STATS)
+	uint64_t n_alloc = wrap_alloc_count();
+#endif
 
 	ctime = cputime(); rtime = realtime();
 	global_bns = bns;
@@ -1295,10 +1633,22 @@ void mem_process_seqs(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bn
 	w.aux = malloc(opt->n_threads * sizeof(smem_aux_t));
 	for (i = 0; i < opt->n_threads; ++i)
 		w.aux[i] = smem_aux_init();
-	kt_for(opt->n_threads, worker1, &w, (opt->flag&MEM_F_PE)? n>>1 : n); // find mapping positions
-	for (i = 0; i < opt->n_threads; ++i)
-		smem_aux_destroy(w.aux[i]);
-	free(w.aux);
+	w.n = (opt->flag&MEM_F_PE)? n>>1 : n;
+	w.frames = 0;
+	if (opt->seed_batch > 1 && !opt->indexInfo.singleStrand) // find mapping positions
+		kt_for(opt->n_threads, worker1_batch, &w, (w.n + opt->seed_batch - 1) / opt->seed_batch);
+	else if (!(opt->flag&MEM_F_PE) && !(opt->proteinFlag & ALIGN_FLAG_MANUAL_PRO)) { // frames compete in filterCompetingAln()
+		w.frames = malloc((n + 1) * sizeof(int));
+		kt_for(opt->n_threads, worker1_frames, &w, mem_frame_groups(seqs, n, w.frames, &w.keep_first));
+		free(w.frames);
+	} else kt_for(opt->n_threads, worker1, &w, w.n);
+#if defined(USE_MALLOC_WRAPPERS) && defined(PALADIN_ALLOC_STATS)
+	// Counted over all threads, including any reading the next batch meanwhile
+	rtime1 = realtime() - rtime;
+	n_alloc = wrap_alloc_count() - n_alloc;
+	logMessage(__func__, LOG_LEVEL_DEBUG, "Seeded and extended %d protein sequences at %.0f per sec with %lu heap allocations (%.1f per sequence)\n",
+		n, n / rtime1, (unsigned long)n_alloc, (double)n_alloc / n);
+#endif
 	if (opt->flag&MEM_F_PE) { // infer insert sizes if not provided
 		if (pes0) memcpy(pes, pes0, VALUE_DOMAIN * sizeof(mem_pestat_t)); // if pes0 != NULL, set the insert-size distribution as pes0
 		else mem_pestat(opt, bns->l_pac, n, w.regs, pes); // otherwise, infer the insert size distribution from data
@@ -1307,7 +1657,26 @@ void mem_process_seqs(const mem_opt_t *opt, const bwt_t *bwt, const bntseq_t *bn
 	// Filter competing alignments from multi-frame encoding during ORF detection process
     filterCompetingAln(&w, n, opt->proteinFlag & ALIGN_FLAG_MANUAL_PRO);
 
-	kt_for(opt->n_threads, worker2, &w, (opt->flag&MEM_F_PE)? n>>1 : n);
+	rtime1 = realtime();
+	if (opt->proteinFlag & ALIGN_FLAG_REPORT_ONLY) kt_for(opt->n_threads, worker2_report, &w, n); // single-end only, see command_align()
+	else kt_for(opt->n_threads, worker2, &w, (opt->flag&MEM_F_PE)? n>>1 : n);
+	rtime1 = realtime() - rtime1;
+
+	for (i = 0, memset(&ext, 0, sizeof(ext)); i < opt->n_threads; ++i) {
+		ext.n += w.aux[i]->ext.n, ext.n_wide += w.aux[i]->ext.n_wide, ext.n_given_up += w.aux[i]->ext.n_given_up;
+		ext.cells += w.aux[i]->ext.cells, ext.cells_wide += w.aux[i]->ext.cells_wide;
+		ext.n_chain_skipped += w.aux[i]->ext.n_chain_skipped, ext.n_seed_skipped += w.aux[i]->ext.n_seed_skipped;
+		ext.n_frame_skipped += w.aux[i]->ext.n_frame_skipped;
+		ext.n_cigar += w.aux[i]->ext.n_cigar, ext.n_cigar_skipped += w.aux[i]->ext.n_cigar_skipped;
+		smem_aux_destroy(w.aux[i]);
+	}
+	free(w.aux);
+	logMessage(__func__, LOG_LEVEL_DEBUG, "Extension cost: %.0f DP cells per protein sequence over %.1f extensions, %.1f%% of cells at a widened band (%lu widened, %lu narrow tries given up early)\n",
+		(double)ext.cells / n, (double)ext.n / n, ext.cells? 100. * ext.cells_wide / ext.cells : 0., (unsigned long)ext.n_wide, (unsigned long)ext.n_given_up);
+	logMessage(__func__, LOG_LEVEL_DEBUG, "Skipped %lu chains and %lu seeds whose extension could not reach %.2f of the best hit, and the chains of %lu frames that could not outscore another frame of their read\n",
+		(unsigned long)ext.n_chain_skipped, (unsigned long)ext.n_seed_skipped, mem_skip_ratio(opt), (unsigned long)ext.n_frame_skipped);
+	logMessage(__func__, LOG_LEVEL_DEBUG, "Generated %lu CIGARs in %.3f real sec (%.0f per sec), skipped %lu hits of filtered frames\n",
+		(unsigned long)ext.n_cigar, rtime1, rtime1 > 0.? ext.n_cigar / rtime1 : 0., (unsigned long)ext.n_cigar_skipped);
 
 	// Prepare Uniprot data (fully if requested)
 	addUniprotList(&w, n, opt->outputStream != stdout);
@@ -5,6 +5,7 @@
 #include "bntseq.h"
 #include "bwa.h"
 #include "bwtindex.h"
+#include "arena.h"
 
 #define MEM_MAPQ_COEF 30.0
 #define MEM_MAPQ_MAX  60
@@ -55,6 +56,7 @@ typedef struct {
 	int max_occ;            // skip a seed if its occurence is larger than this value
 	int max_chain_gap;      // do not chain seed if it is max_chain_gap-bp away from the closest seed
 	int n_threads;          // number of threads
+	int seed_batch;         // ORFs a worker seeds together with the interleaved SMEM search; 1 seeds them one at a time
 	int chunk_size;         // process chunk_size-bp sequences in a batch
 	float mask_level;       // regard a hit as redundant if the overlap with another better hit is over mask_level times the min length of the two hits
 	float drop_ratio;       // drop a chain if its seed coverage is below drop_ratio times the seed coverage of a better chain overlapping with the small chain
@@ -110,8 +112,23 @@ typedef struct { // This struct is only used for the convenience of API.
 	int score, sub, alt_sc;
 } mem_aln_t;
 
+typedef struct {
+	uint64_t n, n_wide, n_given_up; // extension tries, those at a widened band, and narrow ones given up early
+	uint64_t cells, cells_wide; // DP cells computed by all tries, and by those at a widened band
+	uint64_t n_chain_skipped, n_seed_skipped; // chains and seeds left unextended as they cannot score high enough
+	uint64_t n_frame_skipped; // ORFs whose chains were left unextended as another frame of their read is sure to win
+	uint64_t n_cigar, n_cigar_skipped; // hits given a CIGAR by worker2(), and those of filtered frames given neither CIGAR nor mapq
+} mem_extstat_t;
+
 typedef struct {
 	bwtintv_v mem, mem1, *tmpv[2];
+	bwtintv_v *first; // SMEMs of the first pass, when already found by the interleaved search
+	bwtintv_v *batch; // first pass SMEMs of each ORF of a worker batch
+	int m_batch;
+	struct { size_t n, m; bwtint_t *a; } sa; // suffix array positions of the seeds, resolved together
+	arena_t *arena; // chains, seeds and extension buffers of the ORF being aligned, reset after each one
+	void *chain_tree; // chaining B-tree, emptied rather than rebuilt between ORFs
+	mem_extstat_t ext; // cost of the seed extensions made by this thread in the current batch
 } smem_aux_t;
 
 typedef struct {
@@ -124,6 +141,8 @@ typedef struct {
 	bseq1_t *seqs;
 	mem_alnreg_v *regs;
 	int64_t n_processed;
+	int n; // reads, or pairs, handed to the workers
+	int *frames, keep_first; // first entry of each group of competing frames, and whether entry 0 is always kept
 } worker_t;
 
 #ifdef __cplusplus
@@ -200,7 +200,11 @@ int main_shm(int argc, char *argv[])
 		if (bwa_shm_test(argv[optind]) == 0) {
 			bwaidx_t *idx;
 			idx = index_load_from_disk(argv[optind], BWA_IDX_ALL);
-			if (bwa_shm_stage(idx, argv[optind], tmpfn) < 0) {
+			if (idx == 0) {
+				// A .pidx container is already shared through the page cache when mapped
+				fprintf(stderr, "[E::%s] staging requires the separate index files of '%s'\n", __func__, argv[optind]);
+				ret = 1;
+			} else if (bwa_shm_stage(idx, argv[optind], tmpfn) < 0) {
 				fprintf(stderr, "[E::%s] failed to stage the index in shared memory\n", __func__);
 				ret = 1;
 			}
@@ -12,16 +12,53 @@
 #  include "malloc_wrap.h"
 #endif
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define BWT_RANK_X86
+#  include <immintrin.h>
+#endif
+
+// Identifies .bwt files carrying a layout field ahead of <primary> (legacy files start with primary)
+#define BWT_FILE_MAGIC 0x3154574244414C50ULL
+
+// Identifies .sa files holding bit-packed samples ahead of <primary> ("PLDSAPK1")
+#define BWT_SA_MAGIC 0x314B504153444C50ULL
+
+// Identifies .kmer files ("PLDKMER1")
+#define BWT_KMER_MAGIC 0x3152454D4B444C50ULL
+
+// Allocate zeroed, cache line aligned storage for the BWT (in 32-bit integers)
+uint32_t * allocBWT(bwtint_t passSize) {
+	void * ret;
+
+	if (posix_memalign(&ret, 64, passSize * sizeof(uint32_t))) {
+		err_fatal(__func__, "Failed to allocate %llu bytes for the BWT", (unsigned long long) passSize * sizeof(uint32_t));
+	}
+	memset(ret, 0, passSize * sizeof(uint32_t));
+
+	return (uint32_t *) ret;
+}
+
 // Obtain the starting address of the interval in the BWT (post-interleave) for the specified index
 uint32_t * getOccInterval(const bwt_t * passBWT, int64_t passSeqIdx) {
 	int64_t numIntervals;
 
 	numIntervals = passSeqIdx / 128;
 
+	// Compact intervals store 16-bit occurrences padded to a cache line + 128 packed values
+	if (passBWT->layout == BWT_LAYOUT_COMPACT) return passBWT->bwt + numIntervals * BWT_COMPACT_INTV;
+
 	// Each interval stores 64-bit occurrences for each of the values + 128 packed values between
 	return passBWT->bwt + (numIntervals * 2 * VALUE_DOMAIN) + (numIntervals * (128 / 4));
 }
 
+// Obtain the superblock occurrences (compact layout) covering the specified index
+static inline const bwtint_t * getOccSuperblock(const bwt_t * passBWT, bwtint_t passSeqIdx) {
+	const uint32_t * superStart;
+
+	superStart = passBWT->bwt + ((passBWT->seq_len + OCC_INTV_MASK) >> OCC_INTV_SHIFT) * BWT_COMPACT_INTV;
+	return (const bwtint_t *) (superStart + (passSeqIdx >> BWT_COMPACT_SB_SHIFT) * BWT_COMPACT_SB);
+}
+
 // Obtain unpacked byte value from the BWT (post-interleave) at the specified index
 ubyte_t unpackBWTValue(const bwt_t * passBWT, int64_t passSeqIdx) {
 	int64_t packShift;
@@ -30,7 +67,7 @@ ubyte_t unpackBWTValue(const bwt_t * passBWT, int64_t passSeqIdx) {
 	packShift = (8 * (sizeof(uint32_t) - 1)) - (8 * (passSeqIdx % sizeof(uint32_t)));
 
 	bwtValueStart = getOccInterval(passBWT, passSeqIdx);
-	bwtValueStart += sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
+	bwtValueStart += (passBWT->layout == BWT_LAYOUT_COMPACT) ? BWT_COMPACT_INTV - OCC_INTERVAL / 4 : sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
 
 	return (bwtValueStart[(passSeqIdx % 128) / sizeof(uint32_t)] >> packShift) & 0xFF;
 }
@@ -48,6 +85,195 @@ void getOccPerWord(uint32_t passWord, bwtint_t retOcc[VALUE_DOMAIN], int64_t pas
 	}
 }
 
+/****************
+ * Rank kernels *
+ ****************/
+
+// Count the residues of the trailing partial word (BWT symbols are packed MSB first within each word)
+static inline void occ_tail(uint32_t passWord, int passCount, bwtint_t cnt[VALUE_DOMAIN]) {
+	int shift;
+
+	for (shift = 24 ; passCount > 0 ; passCount--, shift -= 8) {
+		++cnt[passWord >> shift & 0xFF];
+	}
+}
+
+static inline void occ_words(const uint32_t *p, int passStart, int passEnd, bwtint_t cnt[VALUE_DOMAIN]) {
+	int i;
+
+	for (i = passStart; i < passEnd; ++i) {
+		uint32_t w = p[i];
+		++cnt[w >> 24]; ++cnt[w >> 16 & 0xFF]; ++cnt[w >> 8 & 0xFF]; ++cnt[w & 0xFF];
+	}
+}
+
+// Add occurrences of the first n (1..OCC_INTERVAL) symbols of a packed BWT block, one word at a time
+static void occ_block(const uint32_t *p, int n, bwtint_t cnt[VALUE_DOMAIN]) {
+	occ_words(p, 0, n >> 2, cnt);
+	if (n & 3) occ_tail(p[n >> 2], n & 3, cnt);
+}
+
+// Paired version for nk <= nl within one block: cntk holds the checkpoint on entry, cntl is filled in
+static void occ_block2(const uint32_t *p, int nk, int nl, bwtint_t cntk[VALUE_DOMAIN], bwtint_t cntl[VALUE_DOMAIN]) {
+	occ_words(p, 0, nk >> 2, cntk);
+	memcpy(cntl, cntk, VALUE_DOMAIN * sizeof(bwtint_t));
+	occ_words(p, nk >> 2, nl >> 2, cntl);
+	if (nk & 3) occ_tail(p[nk >> 2], nk & 3, cntk);
+	if (nl & 3) occ_tail(p[nl >> 2], nl & 3, cntl);
+}
+
+// Count the residues C among the first n (1..OCC_INTERVAL) symbols of a packed BWT block, 8 per 64-bit word
+static bwtint_t occ1_block_scalar(const uint32_t *p, int n, int c) {
+	const uint64_t lo = 0x0101010101010101ULL, hi = 0x7f7f7f7f7f7f7f7fULL;
+	uint64_t x, y = lo * c;
+	bwtint_t ret = 0;
+	int i, nd = n >> 3;
+
+	// A byte of X is zero iff the symbol matches; set the top bit of every non-zero byte and count the rest
+	for (i = 0; i < nd; ++i) {
+		memcpy(&x, p + (i << 1), sizeof(x));
+		x ^= y;
+		ret += 8 - __builtin_popcountll((((x & hi) + hi) | x) & ~hi);
+	}
+	if (n & 4) {
+		uint32_t w = p[i << 1] ^ (uint32_t)y;
+		ret += 4 - __builtin_popcount((((w & (uint32_t)hi) + (uint32_t)hi) | w) & ~(uint32_t)hi);
+	}
+	for (i = 0; i < (n & 3); ++i) ret += (p[n >> 2] >> (24 - 8 * i) & 0xFF) == c;
+
+	return ret;
+}
+
+#ifdef BWT_RANK_X86
+/* The SIMD kernels only count whole words with byte compares and a per-vector byte mask, so that the
+ * reversed byte order within each word (little-endian load of MSB-first packing) does not matter.
+ * The remaining 0-3 symbols of a partial word are compared one at a time. Counting all residues this
+ * way takes one compare pass per residue, which loses to the plain histogram of occ_block(), so only
+ * single-residue counts are vectorized. */
+static inline uint32_t occ_mask(int passBytes, int passWidth) {
+	if (passBytes <= 0) return 0;
+	return passBytes >= passWidth ? (uint32_t)((1ULL << passWidth) - 1) : (1U << passBytes) - 1;
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static bwtint_t occ1_block_sse42(const uint32_t *p, int n, int c) {
+	__m128i y = _mm_set1_epi8(c);
+	int i, nb = n & ~3, nv = (nb + 15) >> 4;
+	bwtint_t ret = 0;
+
+	for (i = 0; i < nv; ++i) {
+		uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p + i), y));
+		ret += _mm_popcnt_u32(m & occ_mask(nb - (i << 4), 16));
+	}
+	for (i = 0; i < (n & 3); ++i) ret += (p[n >> 2] >> (24 - 8 * i) & 0xFF) == c;
+
+	return ret;
+}
+
+__attribute__((target("avx2,popcnt")))
+static bwtint_t occ1_block_avx2(const uint32_t *p, int n, int c) {
+	__m256i y = _mm256_set1_epi8(c);
+	int i, nb = n & ~3, nv = (nb + 31) >> 5;
+	bwtint_t ret = 0;
+
+	for (i = 0; i < nv; ++i) {
+		uint32_t m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p + i), y));
+		ret += _mm_popcnt_u32(m & occ_mask(nb - (i << 5), 32));
+	}
+	for (i = 0; i < (n & 3); ++i) ret += (p[n >> 2] >> (24 - 8 * i) & 0xFF) == c;
+
+	return ret;
+}
+#endif
+
+typedef bwtint_t (*occ1_block_f)(const uint32_t *p, int n, int c);
+
+static bwtint_t occ1_block_resolve(const uint32_t *p, int n, int c);
+static occ1_block_f occ1_block = occ1_block_resolve;
+static int occ_kernel = BWT_RANK_AUTO;
+
+// Kernel picked on first use; every thread resolves to the same function, so the race is benign
+static bwtint_t occ1_block_resolve(const uint32_t *p, int n, int c) {
+	bwt_rank_select(BWT_RANK_AUTO);
+	return occ1_block(p, n, c);
+}
+
+const char * bwt_rank_name(int passKernel) {
+	switch (passKernel) {
+		case BWT_RANK_SCALAR: return "scalar";
+		case BWT_RANK_SSE42: return "sse4.2";
+		case BWT_RANK_AVX2: return "avx2";
+		default: return "auto";
+	}
+}
+
+int bwt_rank_kernel() {
+	if (occ_kernel == BWT_RANK_AUTO) bwt_rank_select(BWT_RANK_AUTO);
+	return occ_kernel;
+}
+
+// Select the single-residue rank kernel used by bwt_occ() and friends; returns the kernel in use, or -1 if unsupported here
+int bwt_rank_select(int passKernel) {
+	int supported = BWT_RANK_SCALAR;
+
+#ifdef BWT_RANK_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) supported = BWT_RANK_SSE42;
+	if (supported == BWT_RANK_SSE42 && __builtin_cpu_supports("avx2")) supported = BWT_RANK_AVX2;
+#endif
+
+	if (passKernel < BWT_RANK_AUTO || passKernel > supported) return -1;
+
+	if (passKernel == BWT_RANK_AUTO) passKernel = supported;
+	switch (passKernel) {
+#ifdef BWT_RANK_X86
+		case BWT_RANK_SSE42: occ1_block = occ1_block_sse42; break;
+		case BWT_RANK_AVX2: occ1_block = occ1_block_avx2; break;
+#endif
+		default: occ1_block = occ1_block_scalar; break;
+	}
+
+	return occ_kernel = passKernel;
+}
+
+/***************
+ * Checkpoints *
+ ***************/
+
+// Load the occurrences preceding the interval of K (already $-adjusted), returning its packed values
+static inline uint32_t * getOccCheckpoint(const bwt_t *bwt, bwtint_t k, bwtint_t cnt[VALUE_DOMAIN]) {
+	const bwtint_t *s;
+	const uint16_t *d;
+	uint32_t *p;
+	int c;
+
+	p = getOccInterval(bwt, k);
+	if (bwt->layout == BWT_LAYOUT_COMPACT) {
+		s = getOccSuperblock(bwt, k);
+		d = (const uint16_t *) p;
+		for (c = 0; c < VALUE_DEFINED; ++c) cnt[c] = s[c] + d[c];
+		memset(cnt + VALUE_DEFINED, 0, (VALUE_DOMAIN - VALUE_DEFINED) * sizeof(bwtint_t));
+		return p + BWT_COMPACT_INTV - OCC_INTERVAL / 4;
+	}
+
+	memcpy(cnt, p, VALUE_DOMAIN * sizeof(bwtint_t));
+	return p + sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
+}
+
+// Single residue version of getOccCheckpoint()
+static inline uint32_t * getOccCheckpoint1(const bwt_t *bwt, bwtint_t k, int c, bwtint_t *n) {
+	uint32_t *p;
+
+	p = getOccInterval(bwt, k);
+	if (bwt->layout == BWT_LAYOUT_COMPACT) {
+		*n = getOccSuperblock(bwt, k)[c] + ((const uint16_t *) p)[c];
+		return p + BWT_COMPACT_INTV - OCC_INTERVAL / 4;
+	}
+
+	*n = ((bwtint_t *) p)[c];
+	return p + sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
+}
+
 static inline bwtint_t bwt_invPsi(const bwt_t *bwt, bwtint_t k) {
 	bwtint_t x = k - (k > bwt->primary);
 
@@ -84,6 +310,55 @@ void bwt_cal_sa(bwt_t *bwt, int intv) {
 
 	// SA[0] is currently set to sequence length - set to maximum value
 	bwt->sa[0] = (bwtint_t)-1;
+	bwt_pack_sa(bwt);
+}
+
+/* Samples are stored plus one in sa_width bits, enough for seq_len + 1, so that SA[0] (set to -1, see
+ * bwt_sa()) is stored as 0. Entry I starts at bit I * sa_width and may straddle two words; a spare word
+ * after the last entry lets every read load both. */
+
+int bwt_sa_bits(bwtint_t seq_len)
+{
+	int ret;
+
+	for (ret = 1; ret < 64 && (seq_len + 1) >> ret; ++ret);
+	return ret;
+}
+
+bwtint_t bwt_sa_words(const bwt_t *bwt)
+{
+	return (bwt->n_sa * bwt->sa_width + 63) / 64 + 1;
+}
+
+void bwt_pack_sa(bwt_t *bwt)
+{
+	bwtint_t i, j, acc, v;
+	int w, n_acc;
+
+	// Entries are read before the word they share is written, so packing can run in place
+	bwt->sa_width = w = bwt_sa_bits(bwt->seq_len);
+	for (i = j = 0, acc = 0, n_acc = 0; i < bwt->n_sa; ++i) {
+		v = bwt->sa[i] + 1;
+		acc |= v << n_acc;
+		if (n_acc + w >= 64) {
+			bwt->sa[j++] = acc;
+			acc = n_acc? v >> (64 - n_acc) : 0;
+			n_acc -= 64;
+		}
+		n_acc += w;
+	}
+	bwt->sa = realloc(bwt->sa, bwt_sa_words(bwt) * sizeof(bwtint_t));
+	while (j < bwt_sa_words(bwt)) bwt->sa[j++] = acc, acc = 0;
+}
+
+// Sample I, branch-free: the high word is shifted in twice so an entry ending on a word boundary adds nothing
+static inline bwtint_t bwt_sa_sample(const bwt_t *bwt, bwtint_t i)
+{
+	bwtint_t bit = i * bwt->sa_width;
+	const bwtint_t *p = bwt->sa + (bit >> 6);
+	int off = bit & 63;
+
+	return ((p[0] >> off | p[1] << (63 - off) << 1) & (((bwtint_t)1 << bwt->sa_width) - 1)) - 1;
 }
 
 bwtint_t bwt_sa(const bwt_t *bwt, bwtint_t k)
@@ -95,90 +370,74 @@ bwtint_t bwt_sa(const bwt_t *bwt, bwtint_t k)
 	}
 	/* without setting bwt->sa[0] = -1, the following line should be
 	   changed to (sa + bwt->sa[k/bwt->sa_intv]) % (bwt->seq_len + 1) */
-	return sa + bwt->sa[k/bwt->sa_intv];
+	return sa + bwt_sa_sample(bwt, k/bwt->sa_intv);
 }
 
-static inline int64_t __occ_aux(uint64_t y, int c) {
-	unsigned char * bytePtr;
-	int64_t count, byteIdx;
+// Number of LF walks bwt_sa_batch() keeps in flight
+#define SA_BATCH_WINDOW 32
 
-	bytePtr = (unsigned char *) &y;
-	count = 0;
-
-	for (byteIdx = 0 ; byteIdx < sizeof(y) ; byteIdx++) {
-		if (bytePtr[byteIdx] == c) count++;
+void bwt_sa_batch(const bwt_t *bwt, int n, const bwtint_t *ks, bwtint_t *out)
+{
+	bwtint_t mask = bwt->sa_intv - 1, k[SA_BATCH_WINDOW], sa[SA_BATCH_WINDOW];
+	int idx[SA_BATCH_WINDOW], i, j, next, n_live;
+
+	for (next = n_live = 0; ; ) {
+		// Refill the window, then advance every walk by one LF step
+		for (; n_live < SA_BATCH_WINDOW && next < n; ++n_live, ++next) {
+			idx[n_live] = next, k[n_live] = ks[next], sa[n_live] = 0;
+			if (k[n_live] & mask) bwt_prefetch_occ(bwt, k[n_live]);
+			else __builtin_prefetch(&bwt->sa[k[n_live] / bwt->sa_intv * bwt->sa_width >> 6]);
+		}
+		if (n_live == 0) break;
+
+		for (i = j = 0; i < n_live; ++i) {
+			if (k[i] & mask) {
+				++sa[i];
+				k[i] = bwt_invPsi(bwt, k[i]);
+				if (k[i] & mask) bwt_prefetch_occ(bwt, k[i]);
+				else __builtin_prefetch(&bwt->sa[k[i] / bwt->sa_intv * bwt->sa_width >> 6]);
+				idx[j] = idx[i], k[j] = k[i], sa[j++] = sa[i];
+			}
+			else out[idx[i]] = sa[i] + bwt_sa_sample(bwt, k[i] / bwt->sa_intv);
+		}
+		n_live = j;
 	}
-
-	return count;
 }
 
 bwtint_t bwt_occ(const bwt_t *bwt, bwtint_t k, ubyte_t c) {
 	bwtint_t n;
-	uint32_t *p, *end;
+	uint32_t *p;
 
-	//test
-	bwtint_t cnt[VALUE_DOMAIN];
-	memset(cnt, VALUE_DOMAIN, sizeof(bwtint_t));
-	bwt_occ4(bwt, k, cnt);
-	return cnt[c];
-
-	if (k == bwt->seq_len) return bwt->L2[c+1] - bwt->L2[c];
 	if (k == (bwtint_t)(-1)) return 0;
 	k -= (k >= bwt->primary); // because $ is not in bwt
 
-	// Retrieve Occurrences at k/OCC_INTERVAL, then advance to first BWT cell
-	n = ((bwtint_t*)(p = getOccInterval(bwt, k)))[c];
-	p += sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
-
-	// calculate Occ up to the last k/32
-	end = p + (((k>>5) - ((k&~OCC_INTV_MASK)>>5))<<1);
-	for (; p < end; p += 2) n += __occ_aux((uint64_t)p[0]<<32 | p[1], c);
-
-	// calculate Occ
-	n += __occ_aux(((uint64_t)p[0]<<32 | p[1]) & ~((1ull<<((~k&31)<<1)) - 1), c);
-	if (c == 0) n -= ~k&31; // corrected for the masked bits
-
-	return n;
+	// Checkpoint for C, then the residues of the interval up to and including K
+	p = getOccCheckpoint1(bwt, k, c, &n);
+	return n + occ1_block(p, (k & OCC_INTV_MASK) + 1, c);
 }
 
 // an analogy to bwt_occ() but more efficient, requiring k <= l
 void bwt_2occ(const bwt_t *bwt, bwtint_t k, bwtint_t l, ubyte_t c, bwtint_t *ok, bwtint_t *ol)
 {
 	bwtint_t _k, _l;
-	_k = (k >= bwt->primary)? k-1 : k;
-	_l = (l >= bwt->primary)? l-1 : l;
-	if (_l/OCC_INTERVAL != _k/OCC_INTERVAL || k == (bwtint_t)(-1) || l == (bwtint_t)(-1)) {
+	uint32_t *p;
+
+	_k = k - (k >= bwt->primary);
+	_l = l - (l >= bwt->primary);
+
+	if (_l>>OCC_INTV_SHIFT != _k>>OCC_INTV_SHIFT || k == (bwtint_t)(-1) || l == (bwtint_t)(-1)) {
 		*ok = bwt_occ(bwt, k, c);
 		*ol = bwt_occ(bwt, l, c);
 	} else {
-		bwtint_t m, n, i, j;
-		uint32_t *p;
-		if (k >= bwt->primary) --k;
-		if (l >= bwt->primary) --l;
-		//n = ((bwtint_t*)(p = bwt_occ_intv(bwt, k)))[c];
-		n = ((bwtint_t*)(p = getOccInterval(bwt, k)))[c];
-		p += sizeof(bwtint_t);
-		// calculate *ok
-		j = k >> 5 << 5;
-		for (i = k/OCC_INTERVAL*OCC_INTERVAL; i < j; i += 32, p += 2)
-			n += __occ_aux((uint64_t)p[0]<<32 | p[1], c);
-		m = n;
-		n += __occ_aux(((uint64_t)p[0]<<32 | p[1]) & ~((1ull<<((~k&31)<<1)) - 1), c);
-		if (c == 0) n -= ~k&31; // corrected for the masked bits
-		*ok = n;
-		// calculate *ol
-		j = l >> 5 << 5;
-		for (; i < j; i += 32, p += 2)
-			m += __occ_aux((uint64_t)p[0]<<32 | p[1], c);
-		m += __occ_aux(((uint64_t)p[0]<<32 | p[1]) & ~((1ull<<((~l&31)<<1)) - 1), c);
-		if (c == 0) m -= ~l&31; // corrected for the masked bits
-		*ol = m;
+		p = getOccCheckpoint1(bwt, _k, c, ok);
+		*ol = *ok + occ1_block(p, (_l & OCC_INTV_MASK) + 1, c);
+		*ok += occ1_block(p, (_k & OCC_INTV_MASK) + 1, c);
 	}
 }
 
 void bwt_occ4(const bwt_t *bwt, bwtint_t k, bwtint_t cnt[VALUE_DOMAIN])
 {
-	uint32_t *p, *end;
+	uint32_t *p;
 
 	// If K is set to max, set counts to 0
 	if (k == (bwtint_t)(-1)) {
@@ -189,69 +448,30 @@ void bwt_occ4(const bwt_t *bwt, bwtint_t k, bwtint_t cnt[VALUE_DOMAIN])
 	k -= (k >= bwt->primary); // because $ is not in bwt
 
 	// Copy current occurrence interval
-	p = getOccInterval(bwt, k);
-	memcpy(cnt, p, VALUE_DOMAIN * sizeof(bwtint_t));
+	p = getOccCheckpoint(bwt, k, cnt);
 
-	// Loop from end of interval to K in unpacked space
-	p += sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
-	end = p + (((k / 16) - ((k&~OCC_INTV_MASK) / 16)) * 4) + ((k % 16) - (k % 4))/4;
-	int supercount = 0;
-
-	for (; p < end; ++p) {
-		cnt[unpackBWTValue(bwt, k/128*128 + supercount)]++;
-		cnt[unpackBWTValue(bwt, k/128*128 + supercount+1)]++;
-		cnt[unpackBWTValue(bwt, k/128*128 + supercount+2)]++;
-		cnt[unpackBWTValue(bwt, k/128*128 + supercount+3)]++;
-		supercount+=4;
-	}
-
-	int testIdx;
-
-	for (testIdx = 0 ; testIdx < (k % 4) + 1 ; testIdx++) {
-		cnt[unpackBWTValue(bwt, k/128*128 + supercount++)]++;
-	}
+	// Count residues from the start of the interval up to and including K
+	occ_block(p, (k & OCC_INTV_MASK) + 1, cnt);
 }
 
 // STEP 2
 // an analogy to bwt_occ4() but more efficient, requiring k <= l
 void bwt_2occ4(const bwt_t *bwt, bwtint_t k, bwtint_t l, bwtint_t cntk[VALUE_DOMAIN], bwtint_t cntl[VALUE_DOMAIN])
 {
-	//bwtint_t _k, _l;
-	//_k = k - (k >= bwt->primary);
-	//_l = l - (l >= bwt->primary);
+	bwtint_t _k, _l;
+	uint32_t *p;
 
-	bwt_occ4(bwt, k, cntk);
-	bwt_occ4(bwt, l, cntl);
+	_k = k - (k >= bwt->primary);
+	_l = l - (l >= bwt->primary);
 
-    // Temporarily bypassing the shortcut method for k <= l and calling the AA version of bwt_occ4 until (if possible) a faster method can be devised
-/*
 	if (_l>>OCC_INTV_SHIFT != _k>>OCC_INTV_SHIFT || k == (bwtint_t)(-1) || l == (bwtint_t)(-1)) {
 		bwt_occ4(bwt, k, cntk);
 		bwt_occ4(bwt, l, cntl);
 	} else {
-		bwtint_t x, y;
-		uint32_t *p, tmp, *endk, *endl;
-		k -= (k >= bwt->primary); // because $ is not in bwt
-		l -= (l >= bwt->primary);
-		p = getOccInterval(bwt, k);
-		memcpy(cntk, p, 4 * sizeof(bwtint_t));
-		p += sizeof(bwtint_t); // sizeof(bwtint_t) = 4*(sizeof(bwtint_t)/sizeof(uint32_t))
-		// prepare cntk[]
-		endk = p + ((k>>4) - ((k&~OCC_INTV_MASK)>>4));
-		endl = p + ((l>>4) - ((l&~OCC_INTV_MASK)>>4));
-		for (x = 0; p < endk; ++p) x += __occ_aux4(bwt, *p);
-		y = x;
-		tmp = *p & ~((1U<<((~k&15)<<1)) - 1);
-		x += __occ_aux4(bwt, tmp) - (~k&15);
-		// calculate cntl[] and finalize cntk[]
-		for (; p < endl; ++p) y += __occ_aux4(bwt, *p);
-		tmp = *p & ~((1U<<((~l&15)<<1)) - 1);
-		y += __occ_aux4(bwt, tmp) - (~l&15);
-		memcpy(cntl, cntk, 4 * sizeof(bwtint_t));
-		cntk[0] += x&0xff; cntk[1] += x>>8&0xff; cntk[2] += x>>16&0xff; cntk[3] += x>>24;
-		cntl[0] += y&0xff; cntl[1] += y>>8&0xff; cntl[2] += y>>16&0xff; cntl[3] += y>>24;
-	}
-	*/
+		// Same occurrence interval - load the checkpoint once and scan the shared prefix once
+		p = getOccCheckpoint(bwt, _k, cntk);
+		occ_block2(p, (_k & OCC_INTV_MASK) + 1, (_l & OCC_INTV_MASK) + 1, cntk, cntl);
+	}
 }
 
 int bwt_match_exact(const bwt_t *bwt, int len, const ubyte_t *str, bwtint_t *sa_begin, bwtint_t *sa_end)
@@ -261,7 +481,7 @@ int bwt_match_exact(const bwt_t *bwt, int len, const ubyte_t *str, bwtint_t *sa_
 	k = 0; l = bwt->seq_len;
 	for (i = len - 1; i >= 0; --i) {
 		ubyte_t c = str[i];
-		if (c > 3) return 0; // no match
+		if (c >= VALUE_DEFINED) return 0; // no match
 		bwt_2occ(bwt, k - 1, l, c, &ok, &ol);
 		k = bwt->L2[c] + ok + 1;
 		l = bwt->L2[c] + ol;
@@ -280,7 +500,7 @@ int bwt_match_exact_alt(const bwt_t *bwt, int len, const ubyte_t *str, bwtint_t
 	k = *k0; l = *l0;
 	for (i = len - 1; i >= 0; --i) {
 		ubyte_t c = str[i];
-		if (c > 3) return 0; // there is an N here. no match
+		if (c >= VALUE_DEFINED) return 0; // ambiguous residue here. no match
 		bwt_2occ(bwt, k - 1, l, c, &ok, &ol);
 		k = bwt->L2[c] + ok + 1;
 		l = bwt->L2[c] + ol;
@@ -314,6 +534,82 @@ void bwt_extend(const bwt_t *bwt, const bwtintv_t *ik, bwtintv_t ok[VALUE_DOMAIN
 	}
 }
 
+/************************
+ * k-mer interval table *
+ ************************/
+/* Seeding pays a full rank per residue for its first extensions, which a table of the intervals of
+ * all short strings answers with one lookup. Entries are extended the way the seeding routines extend
+ * (forward from the first residue, or backward from the last on a single-strand index), so reading one
+ * gives exactly the interval bwt_extend() would. */
+
+bwtint_t bwt_kmer_count(int len)
+{
+	bwtint_t n, ret;
+
+	for (n = VALUE_DEFINED, ret = 0; len > 0; --len, n *= VALUE_DEFINED) ret += n;
+	return ret;
+}
+
+// Entry of the string of LEN unambiguous residues Q, after the shorter strings
+static inline const bwtint_t * bwt_kmer_entry(const bwt_t *bwt, const uint8_t *q, int len)
+{
+	bwtint_t idx;
+	int i;
+
+	for (i = 0, idx = 0; i < len; ++i) idx = idx * VALUE_DEFINED + q[i];
+	return bwt->kmer + (bwt_kmer_count(len - 1) + idx) * 3;
+}
+
+// Set the interval of IK (leaving info) to that of the LEN residues Q
+static inline void bwt_kmer_intv(const bwt_t *bwt, const uint8_t *q, int len, bwtintv_t *ik)
+{
+	const bwtint_t *p = bwt_kmer_entry(bwt, q, len);
+	ik->x[0] = p[0], ik->x[1] = p[1], ik->x[2] = p[2];
+}
+
+// Whether a match of LEN residues can be read from the table, for forward and backward extension
+#define bwt_kmer_fwd(bwt, len) ((len) <= (bwt)->kmer_len && !(bwt)->kmer_back)
+#define bwt_kmer_back(bwt, len) ((len) <= (bwt)->kmer_len && (bwt)->kmer_back)
+
+void bwt_kmer_build(bwt_t *bwt, int len, int is_back)
+{
+	bwtint_t tk[VALUE_DOMAIN], tl[VALUE_DOMAIN], n, i, *p, *q;
+	bwtintv_t ik, ok[VALUE_DOMAIN];
+	int c;
+
+	free(bwt->kmer);
+	bwt->kmer_len = len; bwt->kmer_back = is_back;
+	bwt->kmer = malloc(bwt_kmer_count(len) * 3 * sizeof(bwtint_t));
+
+	// Single residues, as bwt_set_intv()
+	for (c = 0, p = bwt->kmer; c < VALUE_DEFINED; ++c, p += 3) {
+		p[0] = bwt->L2[c] + 1;
+		p[1] = is_back? 0 : bwt->L2[VALUE_DEFINED - 1 - c] + 1;
+		p[2] = bwt->L2[c + 1] - bwt->L2[c];
+	}
+
+	// Each of the N strings at depth Q extends to VALUE_DEFINED strings at the next depth P
+	for (q = bwt->kmer, n = VALUE_DEFINED; --len > 0; q = p, n *= VALUE_DEFINED) {
+		p = q + n * 3;
+		for (i = 0; i < n; ++i) {
+			if (is_back) { // prepending C, as bwt_extend_back1()
+				bwt_2occ4(bwt, q[i * 3] - 1, q[i * 3] - 1 + q[i * 3 + 2], tk, tl);
+				for (c = 0; c < VALUE_DEFINED; ++c) {
+					bwtint_t *r = p + (c * n + i) * 3;
+					r[0] = bwt->L2[c] + tk[c] + 1, r[1] = 0, r[2] = tl[c] - tk[c];
+				}
+			} else { // appending C, as the forward search of bwt_smem1a()
+				ik.x[0] = q[i * 3], ik.x[1] = q[i * 3 + 1], ik.x[2] = q[i * 3 + 2];
+				bwt_extend(bwt, &ik, ok, 0);
+				for (c = 0; c < VALUE_DEFINED; ++c) {
+					bwtint_t *r = p + (i * VALUE_DEFINED + c) * 3;
+					r[0] = ok[VALUE_DEFINED - 1 - c].x[0], r[1] = ok[VALUE_DEFINED - 1 - c].x[1], r[2] = ok[VALUE_DEFINED - 1 - c].x[2];
+				}
+			}
+		}
+	}
+}
+
 static void bwt_reverse_intvs(bwtintv_v *p)
 {
 	if (p->n > 1) {
@@ -350,7 +646,8 @@ int bwt_smem1a(const bwt_t *bwt, int len, const uint8_t *q, int x, int min_intv,
 			break;
 		} else if (q[i] < VALUE_DEFINED) { // an amino acid
 			c = VALUE_DEFINED - 1 - q[i]; // complement of q[i]
-			bwt_extend(bwt, &ik, ok, 0);
+			if (bwt_kmer_fwd(bwt, i - x + 1)) bwt_kmer_intv(bwt, q + x, i - x + 1, &ok[c]);
+			else bwt_extend(bwt, &ik, ok, 0);
 
 			if (ok[c].x[2] != ik.x[2]) { // change of the interval size
 				kv_push(bwtintv_t, *curr, ik);
@@ -414,7 +711,8 @@ int bwt_seed_strategy1(const bwt_t *bwt, int len, const uint8_t *q, int x, int m
 	for (i = x + 1; i < len; ++i) { // forward search
 		if (q[i] < VALUE_DEFINED) { // an amino acid
 		c = VALUE_DEFINED - 1 - q[i]; // complement of q[i]
-		bwt_extend(bwt, &ik, ok, 0);
+		if (bwt_kmer_fwd(bwt, i - x + 1)) bwt_kmer_intv(bwt, q + x, i - x + 1, &ok[c]);
+		else bwt_extend(bwt, &ik, ok, 0);
 		if (ok[c].x[2] < max_intv && i - x >= min_len) {
 			*mem = ok[c];
 			mem->info = (uint64_t)x<<32 | (i + 1);
@@ -426,6 +724,282 @@ int bwt_seed_strategy1(const bwt_t *bwt, int len, const uint8_t *q, int x, int m
 	return len;
 }
 
+/***********************
+ * Interleaved seeding *
+ ***********************/
+/* Each bwt_extend() of the SMEM search is a dependent DRAM miss into the BWT. bwt_smem1_batch() runs the
+ * search of many queries as resumable jobs: a job runs until its next extension is due, the occurrence
+ * data for that extension is prefetched, and the other jobs take their turn before it is resumed. */
+
+void bwt_prefetch_occ(const bwt_t *bwt, bwtint_t k)
+{
+	const char *p;
+	int off, size;
+
+	if (k == (bwtint_t)(-1)) return;
+	k -= (k >= bwt->primary);
+
+	// Checkpoint counts, then the packed residues up to K
+	p = (const char *) getOccInterval(bwt, k);
+	size = (bwt->layout == BWT_LAYOUT_COMPACT) ? (BWT_COMPACT_INTV - OCC_INTERVAL / 4) * 4 : 2 * VALUE_DOMAIN * 4;
+	size += (k & OCC_INTV_MASK) + 1;
+	for (off = 0; off < size; off += 64) __builtin_prefetch(p + off);
+
+	if (bwt->layout == BWT_LAYOUT_COMPACT) {
+		p = (const char *) getOccSuperblock(bwt, k);
+		for (off = 0; off < VALUE_DEFINED * (int) sizeof(bwtint_t); off += 64) __builtin_prefetch(p + off);
+	}
+}
+
+enum { SMEM_JOB_NEXT, SMEM_JOB_FORWARD, SMEM_JOB_BACKWARD, SMEM_JOB_DONE };
+
+// State of one query, holding the locals of bwt_smem1a() (with max_intv of 0) across extensions
+typedef struct {
+	const uint8_t *q;
+	int len, x, ret, i, j, state, ready, is_back;
+	const bwtintv_t *pend; // interval whose extension is due
+	bwtintv_t ik, ok[VALUE_DOMAIN];
+	bwtintv_v a[2], mem1, *prev, *curr;
+} smem_job_t;
+
+// Run a job up to its next extension, left in t->pend (returns 1), or to the end of its query (returns 0)
+static int smem_job_step(const bwt_t *bwt, smem_job_t *t, int min_intv, int min_len, bwtintv_v *mem)
+{
+	bwtintv_v *swap;
+	const bwtintv_t *p;
+	int c, k;
+
+	if (t->pend) {
+		bwt_extend(bwt, t->pend, t->ok, t->is_back);
+		t->pend = 0; t->ready = 1;
+	}
+
+	for (;;) {
+		switch (t->state) {
+		case SMEM_JOB_NEXT: // start bwt_smem1() at the next unambiguous position
+			while (t->x < t->len && t->q[t->x] >= VALUE_DEFINED) ++t->x;
+			if (t->x >= t->len) {
+				t->state = SMEM_JOB_DONE;
+				return 0;
+			}
+			t->mem1.n = 0; t->curr->n = 0;
+			bwt_set_intv(bwt, t->q[t->x], t->ik);
+			t->ik.info = t->x + 1;
+			t->i = t->x + 1;
+			t->state = SMEM_JOB_FORWARD;
+			break;
+
+		case SMEM_JOB_FORWARD:
+			if (t->i < t->len && t->q[t->i] < VALUE_DEFINED) {
+				c = VALUE_DEFINED - 1 - t->q[t->i];
+				if (bwt_kmer_fwd(bwt, t->i - t->x + 1)) bwt_kmer_intv(bwt, t->q + t->x, t->i - t->x + 1, &t->ok[c]);
+				else if (!t->ready) {
+					t->pend = &t->ik; t->is_back = 0;
+					return 1;
+				}
+				t->ready = 0;
+				if (t->ok[c].x[2] != t->ik.x[2]) {
+					kv_push(bwtintv_t, *t->curr, t->ik);
+					if (t->ok[c].x[2] < min_intv) t->state = SMEM_JOB_BACKWARD;
+				}
+				if (t->state == SMEM_JOB_FORWARD) {
+					t->ik = t->ok[c]; t->ik.info = ++t->i;
+					break;
+				}
+			} else kv_push(bwtintv_t, *t->curr, t->ik); // an ambiguous residue or the end of the query
+
+			bwt_reverse_intvs(t->curr);
+			t->ret = t->curr->a[0].info;
+			swap = t->curr; t->curr = t->prev; t->prev = swap;
+			t->i = t->x - 1; t->j = 0; t->curr->n = 0;
+			t->state = SMEM_JOB_BACKWARD;
+			break;
+
+		case SMEM_JOB_BACKWARD:
+			c = t->i < 0? -1 : t->q[t->i] < VALUE_DEFINED? t->q[t->i] : -1;
+			if (t->j < t->prev->n) {
+				p = &t->prev->a[t->j];
+				if (c >= 0 && !t->ready) {
+					t->pend = p; t->is_back = 1;
+					return 1;
+				}
+				t->ready = 0;
+				if (c < 0 || t->ok[c].x[2] < min_intv) {
+					if (t->curr->n == 0 && (t->mem1.n == 0 || t->i + 1 < t->mem1.a[t->mem1.n-1].info>>32)) {
+						t->ik = *p; t->ik.info |= (uint64_t)(t->i + 1)<<32;
+						kv_push(bwtintv_t, t->mem1, t->ik);
+					}
+				} else if (t->curr->n == 0 || t->ok[c].x[2] != t->curr->a[t->curr->n-1].x[2]) {
+					t->ok[c].info = p->info;
+					kv_push(bwtintv_t, *t->curr, t->ok[c]);
+				}
+				++t->j;
+				break;
+			}
+			if (t->curr->n) {
+				swap = t->curr; t->curr = t->prev; t->prev = swap;
+				--t->i; t->j = 0; t->curr->n = 0;
+				break;
+			}
+
+			// This bwt_smem1() is complete; keep its long enough SMEMs
+			bwt_reverse_intvs(&t->mem1);
+			for (k = 0; k < t->mem1.n; ++k)
+				if ((uint32_t)t->mem1.a[k].info - (t->mem1.a[k].info>>32) >= min_len)
+					kv_push(bwtintv_t, *mem, t->mem1.a[k]);
+			t->x = t->ret;
+			t->state = SMEM_JOB_NEXT;
+			break;
+		}
+	}
+}
+
+void bwt_smem1_batch(const bwt_t *bwt, int n, const int *len, const uint8_t *const *q, int min_intv, int min_len, bwtintv_v *mem)
+{
+	smem_job_t *jobs, *t;
+	int *live, n_live, i, k;
+
+	if (min_intv < 1) min_intv = 1;
+	jobs = calloc(n, sizeof(smem_job_t));
+	live = malloc(n * sizeof(int));
+	for (i = 0; i < n; ++i) {
+		jobs[i].q = q[i]; jobs[i].len = len[i];
+		jobs[i].prev = &jobs[i].a[0]; jobs[i].curr = &jobs[i].a[1];
+		live[i] = i;
+	}
+
+	// Each round resumes every live job, whose pending occurrence data was prefetched a round earlier
+	for (n_live = n; n_live > 0; ) {
+		for (i = k = 0; i < n_live; ++i) {
+			t = &jobs[live[i]];
+			if (!smem_job_step(bwt, t, min_intv, min_len, &mem[live[i]])) continue;
+			bwt_prefetch_occ(bwt, t->pend->x[!t->is_back] - 1);
+			bwt_prefetch_occ(bwt, t->pend->x[!t->is_back] - 1 + t->pend->x[2]);
+			live[k++] = live[i];
+		}
+		n_live = k;
+	}
+
+	for (i = 0; i < n; ++i) {
+		free(jobs[i].a[0].a); free(jobs[i].a[1].a); free(jobs[i].mem1.a);
+	}
+	free(live);
+	free(jobs);
+}
+
+/*************************
+ * Single-strand seeding *
+ *************************/
+/* A single-strand protein index holds the forward text only, so intervals can only be extended
+ * backward (bwt_extend() relies on the mirrored half). SMEMs are collected from their ends instead:
+ * the longest match ending at E starts at b(E) and b() never decreases with E. */
+
+// Prepend residue C to the match represented by IK
+static inline void bwt_extend_back1(const bwt_t *bwt, bwtintv_t *ik, int c)
+{
+	bwtint_t ok, ol;
+
+	bwt_2occ(bwt, ik->x[0] - 1, ik->x[0] - 1 + ik->x[2], c, &ok, &ol);
+	ik->x[0] = bwt->L2[c] + ok + 1;
+	ik->x[2] = ol - ok;
+}
+
+// Start of the longest match of at least MIN_INTV occurrences ending at E, not extending past LO or an ambiguous residue
+static int bwt_match_back(const bwt_t *bwt, const uint8_t *q, int lo, int e, int min_intv, bwtintv_t *ik)
+{
+	bwtintv_t t;
+	int i;
+
+	ik->x[0] = bwt->L2[q[e - 1]] + 1;
+	ik->x[2] = bwt->L2[q[e - 1] + 1] - bwt->L2[q[e - 1]];
+	ik->x[1] = 0;
+	if (ik->x[2] < min_intv) return e;
+
+	for (i = e - 2; i >= lo && q[i] < VALUE_DEFINED; --i) {
+		t = *ik;
+		if (bwt_kmer_back(bwt, e - i)) bwt_kmer_intv(bwt, q + i, e - i, &t);
+		else bwt_extend_back1(bwt, &t, q[i]);
+		if (t.x[2] < min_intv) break;
+		*ik = t;
+	}
+
+	return i + 1;
+}
+
+int bwt_smem_ss(const bwt_t *bwt, int len, const uint8_t *q, int x, int min_len, int min_intv, bwtintv_v *mem)
+{
+	bwtintv_t ik, fk;
+	int b, e, f, hi, lo, mid, bound, seg, ret = 0;
+
+	if (min_intv < 1) min_intv = 1;
+	if (x >= 0 && q[x] >= VALUE_DEFINED) return 0;
+
+	// BOUND never underestimates the length of the longest match ending at E
+	for (e = x < 0? 1 : x + 1, bound = len; e <= len; ) {
+		if (q[e - 1] >= VALUE_DEFINED) {
+			if (x >= 0) break;
+			bound = 1; ++e;
+			continue;
+		}
+		if (x >= 0 && bound < e - x) break; // nothing ending here covers X
+		if (bound < min_len) {
+			++bound; ++e;
+			continue;
+		}
+
+		b = bwt_match_back(bwt, q, 0, e, min_intv, &ik);
+		if (x >= 0 && b > x) break;
+		if (e - b < min_len) {
+			bound = e - b + 1; ++e;
+			continue;
+		}
+
+		// Same start for every end up to the right-maximal one: gallop, then bisect
+		for (seg = e; seg < len && q[seg] < VALUE_DEFINED; ++seg);
+		for (lo = e, hi = e + 1, f = 1; hi <= seg; lo = hi, hi = e + (f <<= 1)) {
+			if (bwt_match_back(bwt, q, b, hi, min_intv, &fk) != b) break;
+			ik = fk;
+		}
+		for (hi = (hi <= seg? hi : seg + 1) - 1; lo < hi; ) {
+			mid = (lo + hi + 1) >> 1;
+			if (bwt_match_back(bwt, q, b, mid, min_intv, &fk) == b) lo = mid, ik = fk;
+			else hi = mid - 1;
+		}
+
+		ik.info = (uint64_t)b << 32 | lo;
+		kv_push(bwtintv_t, *mem, ik);
+		++ret;
+
+		bound = lo - b + 1; e = lo + 1;
+	}
+
+	return ret;
+}
+
+int bwt_seed_strategy1_ss(const bwt_t *bwt, const uint8_t *q, int e, int min_len, int max_intv, bwtintv_t *mem)
+{
+	bwtintv_t ik;
+	int i;
+
+	memset(mem, 0, sizeof(bwtintv_t));
+	if (q[e - 1] >= VALUE_DEFINED) return e - 1;
+
+	ik.x[0] = bwt->L2[q[e - 1]] + 1;
+	ik.x[2] = bwt->L2[q[e - 1] + 1] - bwt->L2[q[e - 1]];
+	ik.x[1] = 0;
+	for (i = e - 2; i >= 0; --i) { // backward search
+		if (q[i] >= VALUE_DEFINED) return i;
+		if (bwt_kmer_back(bwt, e - i)) bwt_kmer_intv(bwt, q + i, e - i, &ik);
+		else bwt_extend_back1(bwt, &ik, q[i]);
+		if (ik.x[2] < max_intv && e - 1 - i >= min_len) {
+			*mem = ik;
+			mem->info = (uint64_t)i << 32 | e;
+			return i;
+		}
+	}
+	return 0;
+}
+
 /*************************
  * Read/write BWT and SA *
  *************************/
@@ -435,8 +1009,13 @@ void bwt_dump_bwt(const char *fn, const bwt_t *bwt) {
 
 	fp = xopen(fn, "wb");
 
-	// Format: <primary><L2[1::]><bwt>
-	// Sizes: 8, Domain * 8, BWTSize * 4
+	// Format: [<magic><layout>]<primary><L2[1::]><bwt>
+	// Sizes: [8, 8], 8, Domain * 8, BWTSize * 4 (legacy layout is written without magic and layout)
+	if (bwt->layout != BWT_LAYOUT_LEGACY) {
+		uint64_t magic = BWT_FILE_MAGIC, layout = bwt->layout;
+		err_fwrite(&magic, sizeof(uint64_t), 1, fp);
+		err_fwrite(&layout, sizeof(uint64_t), 1, fp);
+	}
 	err_fwrite(&bwt->primary, sizeof(bwtint_t), 1, fp);
 	err_fwrite(bwt->L2+1, sizeof(bwtint_t), VALUE_DOMAIN, fp);
 	err_fwrite(bwt->bwt, sizeof(uint32_t), bwt->bwt_size, fp);
@@ -445,16 +1024,36 @@ void bwt_dump_bwt(const char *fn, const bwt_t *bwt) {
 }
 
 void bwt_dump_sa(const char *fn, const bwt_t *bwt) {
+	uint64_t magic = BWT_SA_MAGIC, width = bwt->sa_width;
+	bwtint_t intv = bwt->sa_intv;
 	FILE *fp;
 
 	fp = xopen(fn, "wb");
 
-	// Format: <primary><L2[1::]><SA Interval><Seq Length><SA[1::]>
+	// Format: <magic><width><primary><L2[1::]><SA Interval><Seq Length><packed SA>
+	// (legacy files start at <primary> and hold SA[1::] as 64-bit values)
+	err_fwrite(&magic, sizeof(uint64_t), 1, fp);
+	err_fwrite(&width, sizeof(uint64_t), 1, fp);
 	err_fwrite(&bwt->primary, sizeof(bwtint_t), 1, fp);
 	err_fwrite(bwt->L2+1, sizeof(bwtint_t), VALUE_DOMAIN, fp);
-	err_fwrite(&bwt->sa_intv, sizeof(bwtint_t), 1, fp);
+	err_fwrite(&intv, sizeof(bwtint_t), 1, fp);
 	err_fwrite(&bwt->seq_len, sizeof(bwtint_t), 1, fp);
-	err_fwrite(bwt->sa + 1, sizeof(bwtint_t), bwt->n_sa - 1, fp);
+	err_fwrite(bwt->sa, sizeof(bwtint_t), bwt_sa_words(bwt), fp);
+	err_fflush(fp);
+	err_fclose(fp);
+}
+
+void bwt_dump_kmer(const char *fn, const bwt_t *bwt) {
+	uint64_t magic = BWT_KMER_MAGIC, len = bwt->kmer_len, is_back = bwt->kmer_back;
+	FILE *fp;
+
+	fp = xopen(fn, "wb");
+
+	// Format: <magic><depth><backward><intervals of 1..depth residue strings>
+	err_fwrite(&magic, sizeof(uint64_t), 1, fp);
+	err_fwrite(&len, sizeof(uint64_t), 1, fp);
+	err_fwrite(&is_back, sizeof(uint64_t), 1, fp);
+	err_fwrite(bwt->kmer, sizeof(bwtint_t) * 3, bwt_kmer_count(bwt->kmer_len), fp);
 	err_fflush(fp);
 	err_fclose(fp);
 }
@@ -474,40 +1073,84 @@ static bwtint_t fread_fix(FILE *fp, bwtint_t size, void *a)
 void bwt_restore_sa(const char *fn, bwt_t *bwt) {
 	char skipped[256];
 	FILE *fp;
-	bwtint_t primary;
+	bwtint_t primary, intv;
+	uint64_t width = 0;
 
 	fp = xopen(fn, "rb");
 
-	// Format: <primary><L2[1::]><SA Interval><Seq Length><SA[1::]>
+	// Format: [<magic><width>]<primary><L2[1::]><SA Interval><Seq Length><SA>, see bwt_dump_sa()
 	err_fread_noeof(&primary, sizeof(bwtint_t), 1, fp);
+	if (primary == BWT_SA_MAGIC) {
+		err_fread_noeof(&width, sizeof(uint64_t), 1, fp);
+		err_fread_noeof(&primary, sizeof(bwtint_t), 1, fp);
+	}
 	xassert(primary == bwt->primary, "SA-BWT inconsistency: primary is not the same.");
 	err_fread_noeof(skipped, sizeof(bwtint_t), VALUE_DOMAIN, fp); // skip
-	err_fread_noeof(&bwt->sa_intv, sizeof(bwtint_t), 1, fp);
+	err_fread_noeof(&intv, sizeof(bwtint_t), 1, fp);
 	err_fread_noeof(&primary, sizeof(bwtint_t), 1, fp);
 	xassert(primary == bwt->seq_len, "SA-BWT inconsistency: seq_len is not the same.");
 
+	bwt->sa_intv = intv;
 	bwt->n_sa = (bwt->seq_len + bwt->sa_intv) / bwt->sa_intv;
-	bwt->sa = (bwtint_t*)calloc(bwt->n_sa, sizeof(bwtint_t));
-	bwt->sa[0] = -1;
+	if (width) {
+		xassert(width == bwt_sa_bits(bwt->seq_len), "SA-BWT inconsistency: unexpected sample width.");
+		bwt->sa_width = width;
+		bwt->sa = (bwtint_t*)malloc(bwt_sa_words(bwt) * sizeof(bwtint_t));
+		fread_fix(fp, sizeof(bwtint_t) * bwt_sa_words(bwt), bwt->sa);
+	} else { // 64-bit samples of older indexes are packed once read
+		bwt->sa = (bwtint_t*)calloc(bwt->n_sa, sizeof(bwtint_t));
+		bwt->sa[0] = -1;
+		fread_fix(fp, sizeof(bwtint_t) * (bwt->n_sa - 1), bwt->sa + 1);
+		bwt_pack_sa(bwt);
+	}
+	err_fclose(fp);
+}
 
-	fread_fix(fp, sizeof(bwtint_t) * (bwt->n_sa - 1), bwt->sa + 1);
+// The table is optional: without the file, seeding extends from single residues
+void bwt_restore_kmer(const char *fn, bwt_t *bwt) {
+	uint64_t magic, len, is_back;
+	FILE *fp;
+
+	if ((fp = fopen(fn, "rb")) == 0) return;
+
+	err_fread_noeof(&magic, sizeof(uint64_t), 1, fp);
+	xassert(magic == BWT_KMER_MAGIC, "Unknown k-mer table format, please reindex the reference.");
+	err_fread_noeof(&len, sizeof(uint64_t), 1, fp);
+	err_fread_noeof(&is_back, sizeof(uint64_t), 1, fp);
+	xassert(len >= 1 && len <= BWT_KMER_MAX, "Unsupported k-mer table depth.");
+
+	bwt->kmer_len = len; bwt->kmer_back = is_back;
+	bwt->kmer = malloc(bwt_kmer_count(len) * 3 * sizeof(bwtint_t));
+	fread_fix(fp, bwt_kmer_count(len) * 3 * sizeof(bwtint_t), bwt->kmer);
 	err_fclose(fp);
 }
 
 bwt_t *bwt_restore_bwt(const char *fn) {
 	bwt_t *bwt;
 	FILE *fp;
+	uint64_t magic, layout;
+	long headerSize;
 
 	bwt = (bwt_t*)calloc(1, sizeof(bwt_t));
 	fp = xopen(fn, "rb");
-	err_fseek(fp, 0, SEEK_END);
+
+	// Files with a non-legacy layout start with a magic value that can never be a primary index
+	err_fread_noeof(&magic, sizeof(uint64_t), 1, fp);
+	headerSize = sizeof(bwtint_t) * (VALUE_DOMAIN + 1);
+	if (magic == BWT_FILE_MAGIC) {
+		err_fread_noeof(&layout, sizeof(uint64_t), 1, fp);
+		xassert(layout == BWT_LAYOUT_COMPACT, "Unknown BWT layout, please reindex the reference.");
+		bwt->layout = layout;
+		headerSize += 2 * sizeof(uint64_t);
+	}
 
 	// Populate BWT Size and allocate BWT
-	bwt->bwt_size = (err_ftell(fp) - sizeof(bwtint_t) * (VALUE_DOMAIN + 1)) / sizeof(uint32_t);
-	bwt->bwt = (uint32_t*)calloc(bwt->bwt_size, sizeof(uint32_t));
+	err_fseek(fp, 0, SEEK_END);
+	bwt->bwt_size = (err_ftell(fp) - headerSize) / sizeof(uint32_t);
+	bwt->bwt = allocBWT(bwt->bwt_size);
 
 	// Populate Primary, L2[1::], and BWT
-	err_fseek(fp, 0, SEEK_SET);
+	err_fseek(fp, headerSize - sizeof(bwtint_t) * (VALUE_DOMAIN + 1), SEEK_SET);
 	err_fread_noeof(&bwt->primary, sizeof(bwtint_t), 1, fp);
 	err_fread_noeof(bwt->L2+1, sizeof(bwtint_t), VALUE_DOMAIN, fp);
 	fread_fix(fp, bwt->bwt_size * sizeof(uint32_t), bwt->bwt);
@@ -523,6 +1166,6 @@ bwt_t *bwt_restore_bwt(const char *fn) {
 void bwt_destroy(bwt_t *bwt)
 {
 	if (bwt == 0) return;
-	free(bwt->sa); free(bwt->bwt);
+	free(bwt->sa); free(bwt->bwt); free(bwt->kmer);
 	free(bwt);
 }
@@ -14,6 +14,27 @@
 #define OCC_INTERVAL   (1LL<<OCC_INTV_SHIFT)
 #define OCC_INTV_MASK  (OCC_INTERVAL - 1)
 
+// Occurrence count layouts of bwt_t::bwt (see bwt_bwtupdate_core)
+//   LEGACY:  32 x 64-bit counts before every 128 packed residues (384 bytes per interval)
+//   COMPACT: 22 x 16-bit counts relative to a superblock, padded to one cache line, before every 128 packed
+//            residues (192 bytes per interval), with 22 x 64-bit superblock counts every 65536 residues
+//            stored after the last interval
+#define BWT_LAYOUT_LEGACY  0
+#define BWT_LAYOUT_COMPACT 1
+
+#define BWT_COMPACT_SB_SHIFT 16
+#define BWT_COMPACT_INTV     48 // 32-bit integers per interval
+#define BWT_COMPACT_SB       48 // 32-bit integers per superblock
+
+// Deepest k-mer interval table (about 124MB of intervals at 5 residues)
+#define BWT_KMER_MAX 5
+
+// Rank kernels used to count a single residue within an occurrence interval (see bwt_rank_select)
+#define BWT_RANK_AUTO   0
+#define BWT_RANK_SCALAR 1
+#define BWT_RANK_SSE42  2
+#define BWT_RANK_AVX2   3
+
 #ifndef BWA_UBYTE
 #define BWA_UBYTE
 typedef unsigned char ubyte_t;
@@ -26,13 +47,20 @@ typedef struct {
 	bwtint_t L2[VALUE_DOMAIN + 1]; // C(), cumulative count
 	bwtint_t seq_len; // sequence length
 	bwtint_t bwt_size; // size of BWT (in 32-bit integers)
+	int layout; // occurrence count layout (BWT_LAYOUT_*)
 	uint32_t *bwt; // BWT
 	//uint32_t cnt_table[256];
 
 	// Suffix-Array related
 	int sa_intv;
+	int sa_width; // bits per packed sample, see bwt_pack_sa()
 	bwtint_t n_sa;
-	bwtint_t *sa;
+	bwtint_t *sa; // n_sa samples packed in bwt_sa_words() words
+
+	// k-mer interval table (kmer_len of 0 if absent)
+	int kmer_len; // longest string in the table
+	int kmer_back; // built by backward extension, for a single-strand index
+	bwtint_t *kmer; // x[0], x[1] and x[2] of every string of 1 to kmer_len residues
 } bwt_t;
 
 typedef struct {
@@ -62,28 +90,57 @@ typedef struct { size_t n, m; bwtintv_t *a; } bwtintv_v;
 extern "C" {
 #endif
 
+	uint32_t * allocBWT(bwtint_t passSize);
 	uint32_t * getOccInterval(const bwt_t * passBWT, int64_t passSeqIdx);
 	ubyte_t unpackBWTValue(const bwt_t * passBWT, int64_t passSeqIdx);
 	void getOccPerWord(uint32_t passWord, bwtint_t retOcc[VALUE_DOMAIN], int64_t passCount);
 
+	int bwt_rank_select(int passKernel);
+	int bwt_rank_kernel();
+	const char * bwt_rank_name(int passKernel);
+
 	void bwt_dump_bwt(const char *fn, const bwt_t *bwt);
 	void bwt_dump_sa(const char *fn, const bwt_t *bwt);
 
 	bwt_t *bwt_restore_bwt(const char *fn);
 	void bwt_restore_sa(const char *fn, bwt_t *bwt);
+	void bwt_dump_kmer(const char *fn, const bwt_t *bwt);
+	void bwt_restore_kmer(const char *fn, bwt_t *bwt);
 
 	void bwt_destroy(bwt_t *bwt);
 
-	void bwt_bwtgen(const char *fn_pac, const char *fn_bwt); // from BWT-SW
-	void bwt_bwtgen2(const char *fn_pac, const char *fn_bwt, int block_size); // from BWT-SW
 	void bwt_cal_sa(bwt_t *bwt, int intv);
 
-	void bwt_bwtupdate_core(bwt_t *bwt);
+	/**
+	 * Pack the n_sa 64-bit samples of bwt->sa (SA[0] of -1) into bwt_sa_bits(seq_len) bits each, in place.
+	 */
+	void bwt_pack_sa(bwt_t *bwt);
+
+	// Bits per packed SA sample for a BWT of seq_len residues, and the 64-bit words holding bwt->sa
+	int bwt_sa_bits(bwtint_t seq_len);
+	bwtint_t bwt_sa_words(const bwt_t *bwt);
+
+	/**
+	 * Fill the k-mer interval table with the intervals of every string of up to _len_ residues, extending
+	 * forward from the first residue as bwt_smem1() does, or backward from the last when _is_back_.
+	 */
+	void bwt_kmer_build(bwt_t *bwt, int len, int is_back);
+
+	// Number of strings of 1 to len residues, the entries of a table of depth len
+	bwtint_t bwt_kmer_count(int len);
+
+	void bwt_bwtupdate_core(bwt_t *bwt, int n_threads);
 
 	bwtint_t bwt_occ(const bwt_t *bwt, bwtint_t k, ubyte_t c);
 	void bwt_occ4(const bwt_t *bwt, bwtint_t k, bwtint_t cnt[VALUE_DOMAIN]);
 	bwtint_t bwt_sa(const bwt_t *bwt, bwtint_t k);
 
+	/**
+	 * Resolve the suffix array values of _n_ positions, advancing their LF walks in turn so the cache
+	 * misses of one overlap the others.  out[i] = bwt_sa(bwt, ks[i]); _out_ may be _ks_.
+	 */
+	void bwt_sa_batch(const bwt_t *bwt, int n, const bwtint_t *ks, bwtint_t *out);
+
 	// more efficient version of bwt_occ/bwt_occ4 for retrieving two close Occ values
 	//void bwt_gen_cnt_table(bwt_t *bwt);
 	void bwt_2occ(const bwt_t *bwt, bwtint_t k, bwtint_t l, ubyte_t c, bwtint_t *ok, bwtint_t *ol);
@@ -106,6 +163,27 @@ extern "C" {
 
 	int bwt_seed_strategy1(const bwt_t *bwt, int len, const uint8_t *q, int x, int min_len, int max_intv, bwtintv_t *mem);
 
+	/**
+	 * Prefetch the occurrence data that bwt_occ4() reads for _k_.
+	 */
+	void bwt_prefetch_occ(const bwt_t *bwt, bwtint_t k);
+
+	/**
+	 * Run the SMEM pass of bwt_smem1() over every position of _n_ queries at once, stepping their
+	 * extensions in turn and prefetching the occurrence data of each one before it is needed.  SMEMs of
+	 * at least _min_len_ residues are appended to mem[i] in the order the per-query calls would give.
+	 */
+	void bwt_smem1_batch(const bwt_t *bwt, int n, const int *len, const uint8_t *const *q, int min_intv, int min_len, bwtintv_v *mem);
+
+	/**
+	 * Single-strand (forward text only) index versions, using backward search alone.  bwt_smem_ss()
+	 * appends the SMEMs of at least _min_len_ residues and _min_intv_ occurrences to _mem_ (only those
+	 * covering _x_ unless _x_ < 0) and returns how many were added.  bwt_seed_strategy1_ss() anchors the
+	 * seed at its end _e_ and returns the next end to search from.
+	 */
+	int bwt_smem_ss(const bwt_t *bwt, int len, const uint8_t *q, int x, int min_len, int min_intv, bwtintv_v *mem);
+	int bwt_seed_strategy1_ss(const bwt_t *bwt, const uint8_t *q, int e, int min_len, int max_intv, bwtintv_t *mem);
+
 #ifdef __cplusplus
 }
 #endif
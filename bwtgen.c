@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bwt.h"
+#include "bwtindex.h"
+#include "utils.h"
+#include "main.h"
+
+#ifdef USE_MALLOC_WRAPPERS
+#  include "malloc_wrap.h"
+#endif
+
+// Suffixes are distributed into at most 2^BWTGEN_BUCKET_BITS buckets by their leading residues,
+// with the bucket tables taking no more than a quarter of the budget
+#define BWTGEN_BUCKET_BITS 24
+#define BWTGEN_INSERT_SORT 16
+
+// Difference cover {0..31} u {32, 64, ..., 992} modulo 1024, so suffixes sharing 1024 residues
+// are ordered by the ranks of two sampled suffixes at most 1023 residues further in
+#define BWTGEN_DC_SHIFT 10
+#define BWTGEN_DC_PERIOD (1 << BWTGEN_DC_SHIFT)
+#define BWTGEN_DC_ROOT (1 << (BWTGEN_DC_SHIFT / 2))
+
+typedef struct {
+	const ubyte_t * text;
+	int64_t len;
+	int depthCap;
+	int64_t * rank;
+	int64_t classOffset[BWTGEN_DC_PERIOD];
+} BlockSort;
+
+// Index of a sampled suffix, grouped by position modulo the period (negative if not sampled)
+static inline int64_t getSampleIndex(const BlockSort * passSort, int64_t passPos) {
+	int64_t offset = passSort->classOffset[passPos & (BWTGEN_DC_PERIOD - 1)];
+	return (offset < 0) ? -1 : offset + (passPos >> BWTGEN_DC_SHIFT);
+}
+
+// Residue at a suffix offset, with the end of the text sorting before every residue
+static inline int getSuffixValue(const BlockSort * passSort, int64_t passPos) {
+	return (passPos < passSort->len) ? passSort->text[passPos] : -1;
+}
+
+// Order two suffixes sharing their first depthCap residues by the ranks of the sampled suffixes after them
+static int compareSample(const BlockSort * passSort, int64_t passA, int64_t passB) {
+	int64_t offset;
+
+	for (offset = 0 ; getSampleIndex(passSort, passA + offset) < 0 || getSampleIndex(passSort, passB + offset) < 0 ; offset++);
+
+	return (passSort->rank[getSampleIndex(passSort, passA + offset)] < passSort->rank[getSampleIndex(passSort, passB + offset)]) ? -1 : 1;
+}
+
+// Compare two suffixes sharing their first passDepth residues (0 if they also share depthCap residues and no ranks are known)
+static int compareSuffix(const BlockSort * passSort, int64_t passA, int64_t passB, int64_t passDepth) {
+	int valueA, valueB;
+
+	for ( ; passDepth < passSort->depthCap ; passDepth++) {
+		valueA = getSuffixValue(passSort, passA + passDepth);
+		valueB = getSuffixValue(passSort, passB + passDepth);
+		if (valueA != valueB) return (valueA < valueB) ? -1 : 1;
+		if (valueA < 0) return 0;
+	}
+
+	return (passSort->rank) ? compareSample(passSort, passA, passB) : 0;
+}
+
+// Quicksort of suffixes sharing their first depthCap residues
+static void sortSample(const BlockSort * passSort, int64_t * passPos, int64_t passCount) {
+	int64_t idx, store, tmp;
+
+	while (passCount > BWTGEN_INSERT_SORT) {
+		tmp = passPos[passCount/2]; passPos[passCount/2] = passPos[passCount-1]; passPos[passCount-1] = tmp;
+		for (idx = store = 0 ; idx < passCount - 1 ; idx++) {
+			if (compareSample(passSort, passPos[idx], passPos[passCount-1]) < 0) {
+				tmp = passPos[store]; passPos[store++] = passPos[idx]; passPos[idx] = tmp;
+			}
+		}
+		tmp = passPos[store]; passPos[store] = passPos[passCount-1]; passPos[passCount-1] = tmp;
+
+		// Recurse into the smaller side
+		if (store < passCount - store - 1) {
+			sortSample(passSort, passPos, store);
+			passPos += store + 1;
+			passCount -= store + 1;
+		}
+		else {
+			sortSample(passSort, passPos + store + 1, passCount - store - 1);
+			passCount = store;
+		}
+	}
+
+	for (idx = 1 ; idx < passCount ; idx++) {
+		for (tmp = passPos[idx], store = idx ; store > 0 && compareSample(passSort, passPos[store-1], tmp) > 0 ; store--) {
+			passPos[store] = passPos[store-1];
+		}
+		passPos[store] = tmp;
+	}
+}
+
+// Multikey quicksort of suffixes sharing their first passDepth residues
+static void sortSuffixes(const BlockSort * passSort, int64_t * passPos, int64_t passCount, int64_t passDepth) {
+	int64_t lt, gt, idx, tmp, a, b, c;
+	int pivot, value;
+
+	while (passCount > 1) {
+		if (passDepth >= passSort->depthCap) {
+			if (passSort->rank) sortSample(passSort, passPos, passCount);
+			return;
+		}
+
+		if (passCount < BWTGEN_INSERT_SORT) {
+			for (idx = 1 ; idx < passCount ; idx++) {
+				for (tmp = passPos[idx], lt = idx ; lt > 0 && compareSuffix(passSort, passPos[lt-1], tmp, passDepth) > 0 ; lt--) {
+					passPos[lt] = passPos[lt-1];
+				}
+				passPos[lt] = tmp;
+			}
+			return;
+		}
+
+		// Median of three pivot
+		a = getSuffixValue(passSort, passPos[0] + passDepth);
+		b = getSuffixValue(passSort, passPos[passCount/2] + passDepth);
+		c = getSuffixValue(passSort, passPos[passCount-1] + passDepth);
+		pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a)) : ((a < c) ? a : ((b < c) ? c : b));
+
+		// Three-way partition on the residue at the current depth
+		for (lt = 0, idx = 0, gt = passCount ; idx < gt ; ) {
+			value = getSuffixValue(passSort, passPos[idx] + passDepth);
+			if (value < pivot) {
+				tmp = passPos[lt]; passPos[lt++] = passPos[idx]; passPos[idx++] = tmp;
+			}
+			else if (value > pivot) {
+				tmp = passPos[--gt]; passPos[gt] = passPos[idx]; passPos[idx] = tmp;
+			}
+			else idx++;
+		}
+
+		sortSuffixes(passSort, passPos, lt, passDepth);
+		sortSuffixes(passSort, passPos + gt, passCount - gt, passDepth);
+
+		// Only one suffix can end at this depth, otherwise continue with the next residue
+		if (pivot < 0) return;
+		passPos += lt;
+		passCount = gt - lt;
+		passDepth++;
+	}
+}
+
+// Rank the difference cover sample: name each sampled suffix by its leading residues (one past the
+// period, so the last suffix of each class has a unique name), then suffix sort the names class by class
+static int rankSample(BlockSort * passSort, int64_t passSampleNum) {
+	int64_t * posBuf, * nameBuf, * saBuf;
+	int64_t i, c, name;
+
+	posBuf = malloc(passSampleNum * sizeof(int64_t));
+	for (c = 0, i = 0 ; c < BWTGEN_DC_PERIOD ; c++) {
+		if (passSort->classOffset[c] < 0) continue;
+		for (name = c ; name < passSort->len ; name += BWTGEN_DC_PERIOD) posBuf[i++] = name;
+	}
+
+	passSort->rank = 0;
+	passSort->depthCap = BWTGEN_DC_PERIOD + 1;
+	sortSuffixes(passSort, posBuf, passSampleNum, 0);
+
+	nameBuf = malloc(passSampleNum * sizeof(int64_t));
+	for (i = 0, name = 0 ; i < passSampleNum ; i++) {
+		if (i > 0 && compareSuffix(passSort, posBuf[i-1], posBuf[i], 0)) name++;
+		nameBuf[getSampleIndex(passSort, posBuf[i])] = name;
+	}
+	free(posBuf);
+
+	// Ranks replace the names
+	saBuf = malloc(passSampleNum * sizeof(int64_t));
+	if (is_sa_int64(nameBuf, saBuf, passSampleNum, name + 1)) {
+		free(saBuf);
+		free(nameBuf);
+		return -1;
+	}
+	for (i = 0 ; i < passSampleNum ; i++) nameBuf[saBuf[i]] = i;
+	free(saBuf);
+
+	passSort->rank = nameBuf;
+	passSort->depthCap = BWTGEN_DC_PERIOD;
+
+	return 0;
+}
+
+typedef struct {
+	const BlockSort * blockSort;
+	int64_t * posBuf;
+	const int64_t * bucketCount;
+	const int64_t * bucketEnd;
+	int64_t blockFirst;
+	int depth;
+} BlockWorker;
+
+// Sort the suffixes of one bucket of the current block
+static void sortBucket(void * passData, long passIdx, int passThread) {
+	BlockWorker * worker = (BlockWorker *) passData;
+	int64_t bucket = worker->blockFirst + passIdx;
+
+	sortSuffixes(worker->blockSort, worker->posBuf + worker->bucketEnd[bucket] - worker->bucketCount[bucket], worker->bucketCount[bucket], worker->depth);
+}
+
+/**
+ * Constructs the burrows-wheeler transformed string within a bounded amount of working memory.
+ * Suffixes are bucketed by their leading residues, and each group of buckets that fits in the
+ * budget is collected by a scan of the text and sorted in place. Suffixes sharing more than
+ * 1024 residues are ordered by a ranked difference cover sample (about 6% of the suffixes), so
+ * long repeats do not make the sort quadratic. The buckets of a block are sorted on n_threads
+ * threads. The output is identical to is_bwt_sa(), with the transform packed 4 residues per 32-bit word.
+ * @param T[0..n-1] The input string (left intact).
+ * @param n The length of the given string.
+ * @param B[0..(n+3)/4-1] The packed output, zero filled by the caller.
+ * @param sa_intv The sampling interval (0 to keep none).
+ * @param sa[0..n/sa_intv] The sampled suffix array, SA[i*sa_intv] (SA[0] is the position of $, n).
+ * @param mem Working memory budget in bytes, besides T, B and sa.
+ * @param n_threads The number of sorting threads.
+ * @return The primary index if no error occurred, -1 if the budget is too small.
+ */
+int64_t bwtgen_bwt_sa(const ubyte_t *T, int64_t n, uint32_t *B, int sa_intv, int64_t *sa, int64_t mem, int n_threads)
+{
+	extern void kt_for(int n_threads, void (*func)(void*,long,int), void *data, long n);
+	BlockSort blockSort;
+	BlockWorker worker;
+	int64_t * bucketCount, * bucketOffset, * posBuf;
+	int64_t i, j, row, primary, maxCount, sampleNum, blockCount, blockFirst, blockLast, bucketNum, bucketHigh, key;
+	int sigma, base, depth;
+
+	// Sample every position congruent to a member of the difference cover
+	blockSort.text = T;
+	blockSort.len = n;
+	for (i = 0, sampleNum = 0 ; i < BWTGEN_DC_PERIOD ; i++) {
+		if (i < BWTGEN_DC_ROOT || i % BWTGEN_DC_ROOT == 0) {
+			blockSort.classOffset[i] = sampleNum;
+			sampleNum += (i < n) ? (n - i + BWTGEN_DC_PERIOD - 1) >> BWTGEN_DC_SHIFT : 0;
+		}
+		else blockSort.classOffset[i] = -1;
+	}
+
+	// Ranking the sample needs the positions, names, a suffix array of the names and its buckets at once
+	if (mem < 4 * sampleNum * (int64_t)sizeof(int64_t)) return -1;
+	mem -= sampleNum * sizeof(int64_t);
+
+	// Bucket on as many leading residues as the tables allow
+	for (i = sigma = 0 ; i < n ; i++) if (T[i] >= sigma) sigma = T[i] + 1;
+	base = sigma + 1;
+	for (depth = 1, bucketNum = base ; bucketNum * base <= (1LL << BWTGEN_BUCKET_BITS) && bucketNum * base <= mem / 64 ; depth++) bucketNum *= base;
+	bucketHigh = bucketNum / base;
+
+	// Whatever is left after the ranks and the bucket tables holds suffix positions
+	maxCount = (mem - 2 * bucketNum * (int64_t)sizeof(int64_t)) / (int64_t)sizeof(int64_t);
+	if (maxCount > n) maxCount = n;
+
+	bucketCount = calloc(bucketNum, sizeof(int64_t));
+
+	// Bucket sizes, the key being the first 'depth' residues with the end of the text as 0
+	for (i = 0, key = 0 ; i < depth ; i++) key = key * base + ((i < n) ? T[i] + 1 : 0);
+	for (i = 0 ; i < n ; i++) {
+		bucketCount[key]++;
+		key = (key % bucketHigh) * base + ((i + depth < n) ? T[i + depth] + 1 : 0);
+	}
+
+	// The largest bucket must fit on its own
+	for (i = 0 ; i < bucketNum ; i++) {
+		if (bucketCount[i] > maxCount) {
+			free(bucketCount);
+			return -1;
+		}
+	}
+
+	if (rankSample(&blockSort, sampleNum)) {
+		free(bucketCount);
+		return -1;
+	}
+
+	bucketOffset = malloc(bucketNum * sizeof(int64_t));
+	posBuf = malloc(maxCount * sizeof(int64_t));
+
+	worker.blockSort = &blockSort;
+	worker.posBuf = posBuf;
+	worker.bucketCount = bucketCount;
+	worker.bucketEnd = bucketOffset;
+	worker.depth = depth;
+
+	// Row 0 is the empty suffix, preceded by the last residue
+	B[0] |= (uint32_t)T[n - 1] << 24;
+	if (sa_intv) sa[0] = n;
+	primary = 0;
+
+	for (blockFirst = 0, row = 1 ; blockFirst < bucketNum ; blockFirst = blockLast) {
+		// Gather consecutive buckets up to the budget
+		for (blockLast = blockFirst, blockCount = 0 ; blockLast < bucketNum && blockCount + bucketCount[blockLast] <= maxCount ; blockLast++) {
+			bucketOffset[blockLast] = blockCount;
+			blockCount += bucketCount[blockLast];
+		}
+		if (!blockCount) continue;
+
+		// Collect the suffixes of this block in bucket order
+		for (i = 0, key = 0 ; i < depth ; i++) key = key * base + ((i < n) ? T[i] + 1 : 0);
+		for (i = 0 ; i < n ; i++) {
+			if (key >= blockFirst && key < blockLast) posBuf[bucketOffset[key]++] = i;
+			key = (key % bucketHigh) * base + ((i + depth < n) ? T[i + depth] + 1 : 0);
+		}
+
+		worker.blockFirst = blockFirst;
+		kt_for(n_threads, sortBucket, &worker, blockLast - blockFirst);
+
+		// Emit the preceding residue of each row, skipping the row of the whole text
+		for (i = 0 ; i < blockCount ; i++, row++) {
+			if (sa_intv && row % sa_intv == 0) sa[row / sa_intv] = posBuf[i];
+			if (posBuf[i] == 0) {
+				primary = row;
+				continue;
+			}
+			j = primary ? row - 1 : row;
+			B[j >> 2] |= (uint32_t)T[posBuf[i] - 1] << ((~j & 3) << 3);
+		}
+	}
+
+	free(posBuf);
+	free(bucketCount);
+	free(bucketOffset);
+	free(blockSort.rank);
+
+	return primary;
+}
@@ -3,11 +3,11 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
-#include <time.h>
 #include <zlib.h>
 #include "bwtindex.h"
 #include "protein.h"
 #include "bntseq.h"
+#include "bwa.h"
 #include "utils.h"
 #include "uniprot.h"
 #include "main.h"
@@ -22,16 +22,21 @@
 
 // Write header for index pro file
 void writeIndexHeader(FILE * passFilePtr, IndexHeader passHeader) {
-	fprintf(passFilePtr, ">VER=%s:NT=%d:MF=%d:RT=%d\n", PACKAGE_VERSION,
-														passHeader.nucleotide,
-														passHeader.multiFrame,
-														passHeader.referenceType);
+	fprintf(passFilePtr, ">VER=%s:NT=%d:MF=%d:RT=%d:OL=%d:SS=%d", PACKAGE_VERSION,
+																passHeader.nucleotide,
+																passHeader.multiFrame,
+																passHeader.referenceType,
+																passHeader.occLayout,
+																passHeader.singleStrand);
+	if (passHeader.saInterval > 0) fprintf(passFilePtr, ":SA=%d", passHeader.saInterval);
+	fprintf(passFilePtr, "\n");
 }
 
 // Get header info from index pro file
 IndexHeader getIndexHeader(char * passFile) {
 	FILE * filePtr;
 	IndexHeader retHeader;
+	char lineBuf[256], * field;
 
 	// Open file and read header information
 	filePtr = fopen(passFile, "r");
@@ -50,6 +55,20 @@ IndexHeader getIndexHeader(char * passFile) {
 		logMessage(__func__, LOG_LEVEL_ERROR, "Failed to parse file '%s'\n", passFile);
     	exit(EXIT_FAILURE);
 	}
+
+	// Optional fields, absent from indexes created by older versions
+	retHeader.occLayout = BWT_LAYOUT_LEGACY;
+	retHeader.singleStrand = 0;
+	retHeader.saInterval = 32;
+
+	if (fgets(lineBuf, sizeof(lineBuf), filePtr)) {
+		for (field = strtok(lineBuf, ":\r\n") ; field ; field = strtok(NULL, ":\r\n")) {
+			sscanf(field, "OL=%d", &(retHeader.occLayout));
+			sscanf(field, "SS=%d", &(retHeader.singleStrand));
+			sscanf(field, "SA=%d", &(retHeader.saInterval));
+		}
+	}
+
 	fclose(filePtr);
 
 	return retHeader;
@@ -57,6 +76,10 @@ IndexHeader getIndexHeader(char * passFile) {
 
 // Calculate if specified header version is compatible with software
 int getIndexCompatible(IndexHeader passHeader) {
+	// Check if index uses a layout this version can read
+	if ((passHeader.occLayout < BWT_LAYOUT_LEGACY) || (passHeader.occLayout > BWT_LAYOUT_COMPACT)) return INDEX_COMPATIBILITY_NONE;
+	if ((passHeader.singleStrand < 0) || (passHeader.singleStrand > 1)) return INDEX_COMPATIBILITY_NONE;
+
 	// Check if index newer than current version
 	while (1) {
 		if (passHeader.version[0] < PACKAGE_VERSION_MAJOR) break;
@@ -112,55 +135,99 @@ int64_t bwa_seq_len(const char *fn_pac) {
 	return pac_len - 1;
 }
 
-// Populate the BWT from a packed file
-bwt_t * bwt_pac2bwt(const char *fn_pac) {
+// Populate the BWT from an unpacked sequence (released here), sampling the suffix array every passSAIntv rows (0 to skip).
+// A non-zero passMemBudget (bytes) switches to blockwise construction when SA-IS would not fit in it, as do extra threads.
+// Returns 0 when the budget is too small even for that
+bwt_t * bwt_seq2bwt(ubyte_t * passSeq, int64_t passLen, int passSAIntv, int64_t passMemBudget, int passThreads) {
 	bwt_t *bwt;
-	ubyte_t * packedBuf, * unpackedBuf;
-	int64_t i, packedSize;
-	FILE *fp;
+	int64_t i, primary, saBytes, workBytes;
 
 	// Initialize BWT structure
 	bwt = (bwt_t*)calloc(1, sizeof(bwt_t));
-	bwt->seq_len = bwa_seq_len(fn_pac);
+	bwt->seq_len = passLen;
 	bwt->bwt_size = (bwt->seq_len + sizeof(uint32_t) - 1) / sizeof(uint32_t);
-
-	fp = xopen(fn_pac, "rb");
-
-	// Prepare buffers
-	packedSize = bwt->seq_len;
-	packedBuf = (ubyte_t*)calloc(packedSize, 1);
-	unpackedBuf = (ubyte_t*)calloc(bwt->seq_len + 1, 1);
 	memset(bwt->L2, 0, (VALUE_DOMAIN + 1) * sizeof(bwtint_t));
 
-	err_fread_noeof(packedBuf, 1, packedSize, fp);
-	err_fclose(fp);
-
-	// Unpack sequence, record occurrence
+	// Record occurrence
 	for (i = 0; i < bwt->seq_len; ++i) {
-		unpackedBuf[i] = packedBuf[i];
-		++bwt->L2[unpackedBuf[i] + 1];
+		++bwt->L2[passSeq[i] + 1];
 	}
-	free(packedBuf);
 
 	// Accumulate lower occurrences
 	for (i = 2; i <= VALUE_DOMAIN ; ++i) {
 		bwt->L2[i] += bwt->L2[i-1];
 	}
 
-	// Burrows-Wheeler Transform
-	bwt->primary = is_bwt(unpackedBuf, bwt->seq_len);
+	// Burrows-Wheeler Transform, keeping the sampled suffix array computed along the way
+	saBytes = 0;
+	if (passSAIntv > 0) {
+		xassert((passSAIntv & (passSAIntv - 1)) == 0, "SA sample interval is not a power of 2.");
+		bwt->sa_intv = passSAIntv;
+		bwt->n_sa = (bwt->seq_len + passSAIntv) / passSAIntv;
+		bwt->sa = (bwtint_t*)calloc(bwt->n_sa, sizeof(bwtint_t));
+		saBytes = bwt->n_sa * sizeof(bwtint_t);
+	}
 
-	// Pack result into BWT
+	// SA-IS holds a full 64-bit suffix array next to the text, the packed BWT follows it.
+	// Blockwise construction sorts blocks in parallel within the same footprint when no budget is given
+	// Kept signed throughout, so a budget below the text and BWT leaves workBytes negative rather than wrapping
+	workBytes = (passLen + 1) * (int64_t)sizeof(int64_t);
+	if (passMemBudget > 0) workBytes = passMemBudget - (passLen + 1) - saBytes - (int64_t)(bwt->bwt_size * sizeof(uint32_t));
 	bwt->bwt = (u_int32_t*)calloc(bwt->bwt_size, sizeof(uint32_t));
-	for (i = 0; i < bwt->seq_len; ++i) {
-		packValue(bwt, i, unpackedBuf[i]);
+
+	if (passThreads <= 1 && workBytes >= (passLen + 1) * (int64_t)sizeof(int64_t)) {
+		bwt->primary = is_bwt_sa(passSeq, bwt->seq_len, passSAIntv, (int64_t *) bwt->sa);
+
+		// Pack result into BWT
+		for (i = 0; i < bwt->seq_len; ++i) {
+			packValue(bwt, i, passSeq[i]);
+		}
+	}
+	else {
+		primary = bwtgen_bwt_sa(passSeq, bwt->seq_len, bwt->bwt, passSAIntv, (int64_t *) bwt->sa, workBytes, passThreads);
+		if (primary < 0) {
+			logMessage(__func__, LOG_LEVEL_ERROR, "A memory budget of %lld KB is too small for %lld residues\n", (long long) (passMemBudget >> 10), (long long) passLen);
+			bwt_destroy(bwt);
+			free(passSeq);
+			return 0;
+		}
+		bwt->primary = primary;
+	}
+
+	// SA[0] is the position of $ - set to maximum value
+	if (bwt->sa) {
+		bwt->sa[0] = (bwtint_t)-1;
+		bwt_pack_sa(bwt);
 	}
 
-	free(unpackedBuf);
+	free(passSeq);
 
 	return bwt;
 }
 
+// Populate the BWT from a packed file, sampling the suffix array every passSAIntv rows (0 to skip)
+bwt_t * bwt_pac2bwt(const char *fn_pac, int passSAIntv, int64_t passMemBudget) {
+	ubyte_t * unpackedBuf;
+	int64_t seqLen;
+	uint64_t magic = 0;
+	FILE *fp;
+
+	// Residues are stored one per byte, so the pac is read as is
+	fp = xopen(fn_pac, "rb");
+	if (fread(&magic, sizeof(magic), 1, fp) == 1 && magic == BNS_PAC_MAGIC)
+		err_fatal(__func__, "'%s' is packed at 5 bits per residue; rebuild the index without -b to use it here", fn_pac);
+	err_fclose(fp);
+
+	seqLen = bwa_seq_len(fn_pac);
+	unpackedBuf = (ubyte_t*)calloc(seqLen + 1, 1);
+
+	fp = xopen(fn_pac, "rb");
+	err_fread_noeof(unpackedBuf, 1, seqLen, fp);
+	err_fclose(fp);
+
+	return bwt_seq2bwt(unpackedBuf, seqLen, passSAIntv, passMemBudget, 1);
+}
+
 // 'pac2bwt' command entry point. (Note: bwt generated at this step CANNOT be used with BWA, bwtupdate required)
 int command_pac2bwt(int argc, char *argv[]) {
 	bwt_t *bwt;
@@ -174,47 +241,129 @@ int command_pac2bwt(int argc, char *argv[]) {
 		fprintf(stderr, "Usage: paladin pac2bwt <in.pac> <out.bwt>\n");
 		return 1;
 	}
-	bwt = bwt_pac2bwt(argv[optind]);
+	bwt = bwt_pac2bwt(argv[optind], 0, 0);
 	bwt_dump_bwt(argv[optind+1], bwt);
 	bwt_destroy(bwt);
 	return 0;
 }
 
-// Interleave occurrence counts into the BWT at specified interval for efficient search
-void bwt_bwtupdate_core(bwt_t *bwt) {
-	int64_t i, k, counts[VALUE_DOMAIN], n_occ;
+// Residues per unit of work when interleaving occurrence counts (a whole number of compact superblocks)
+#define UPDATE_CHUNK_SHIFT 22
+
+typedef struct {
+	bwt_t * bwt;
 	uint32_t * bwtBuf;
+	int64_t * chunkCounts;
+} UpdateWorker;
 
-	// Initialize counts array
-	memset(counts, 0, sizeof(counts));
+// Tally the residues of one chunk of the packed BWT
+static void countUpdateChunk(void * passData, long passChunk, int passThread) {
+	UpdateWorker * worker = (UpdateWorker *) passData;
+	int64_t i, end, * counts;
 
-	// Adjust the FM-Index size by the number of interleaved occurrence counts
-	n_occ = (bwt->seq_len + OCC_INTERVAL - 1) / OCC_INTERVAL + 1;
-	bwt->bwt_size += n_occ * sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
-	bwtBuf = (uint32_t*)calloc(bwt->bwt_size, sizeof(uint32_t));
-
-	// Iterate through each packed value in the current FM-Index
-	for (i = k = 0; i < bwt->seq_len; ++i) {
-		// For each occurrence interval, insert the number of running occurrences
-		if (i % OCC_INTERVAL == 0) {
-			memcpy(bwtBuf + k, counts, sizeof(bwtint_t) * VALUE_DOMAIN);
-			k += sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
+	counts = worker->chunkCounts + passChunk * VALUE_DOMAIN;
+	end = (passChunk + 1) << UPDATE_CHUNK_SHIFT;
+	if (end > worker->bwt->seq_len) end = worker->bwt->seq_len;
+
+	for (i = passChunk << UPDATE_CHUNK_SHIFT; i < end; ++i) {
+		++counts[unpackValue(worker->bwt, i)];
+	}
+}
+
+// Interleave the occurrence counts of one chunk, starting from the occurrences before it.
+// Legacy intervals hold 64-bit counts, compact intervals 16-bit counts relative to 64-bit superblock counts
+static void fillUpdateChunk(void * passData, long passChunk, int passThread) {
+	UpdateWorker * worker = (UpdateWorker *) passData;
+	bwt_t * bwt = worker->bwt;
+	int64_t i, c, end, n_intv, counts[VALUE_DOMAIN], superCounts[VALUE_DOMAIN];
+	uint32_t * intvBuf;
+	uint16_t * deltaBuf;
+	bwtint_t * superBuf;
+
+	memcpy(counts, worker->chunkCounts + passChunk * VALUE_DOMAIN, sizeof(counts));
+	memset(superCounts, 0, sizeof(superCounts));
+	end = (passChunk + 1) << UPDATE_CHUNK_SHIFT;
+	if (end > bwt->seq_len) end = bwt->seq_len;
+
+	n_intv = (bwt->seq_len + OCC_INTERVAL - 1) / OCC_INTERVAL;
+	superBuf = (bwtint_t *) (worker->bwtBuf + n_intv * BWT_COMPACT_INTV);
+	intvBuf = worker->bwtBuf;
+
+	for (i = passChunk << UPDATE_CHUNK_SHIFT; i < end; ++i) {
+		if (bwt->layout == BWT_LAYOUT_COMPACT) {
+			// Running occurrences at each superblock
+			if ((i & ((1LL << BWT_COMPACT_SB_SHIFT) - 1)) == 0) {
+				memcpy(superCounts, counts, sizeof(counts));
+				for (c = 0; c < VALUE_DEFINED; ++c) superBuf[(i >> BWT_COMPACT_SB_SHIFT) * (BWT_COMPACT_SB / 2) + c] = counts[c];
+			}
+
+			// Occurrences relative to the superblock at each interval (at most 2^16 - OCC_INTERVAL)
+			if (i % OCC_INTERVAL == 0) {
+				intvBuf = worker->bwtBuf + (i / OCC_INTERVAL) * BWT_COMPACT_INTV;
+				deltaBuf = (uint16_t *) intvBuf;
+				for (c = 0; c < VALUE_DEFINED; ++c) deltaBuf[c] = counts[c] - superCounts[c];
+				intvBuf += BWT_COMPACT_INTV - OCC_INTERVAL / 4;
+			}
+		}
+		else if (i % OCC_INTERVAL == 0) {
+			// For each occurrence interval, insert the number of running occurrences
+			intvBuf = worker->bwtBuf + (i / OCC_INTERVAL) * (sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN + OCC_INTERVAL / 4);
+			memcpy(intvBuf, counts, sizeof(bwtint_t) * VALUE_DOMAIN);
+			intvBuf += sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
 		}
 
 		// Copy packed value
-		if (i % 4 == 0) bwtBuf[k++] = bwt->bwt[i/4];
+		if (i % 4 == 0) intvBuf[(i % OCC_INTERVAL) / 4] = bwt->bwt[i/4];
 
 		// Unpack and record current occurrence
 		++counts[unpackValue(bwt, i)];
 	}
+}
+
+// Interleave occurrence counts into the BWT at specified interval for efficient search.
+// Chunks are tallied, then filled from the accumulated tallies, on passThreads threads
+void bwt_bwtupdate_core(bwt_t *bwt, int passThreads) {
+	extern void kt_for(int n_threads, void (*func)(void*,long,int), void *data, long n);
+	int64_t i, c, n_chunk, n_intv, n_super;
+	UpdateWorker worker;
+
+	n_chunk = (bwt->seq_len + (1LL << UPDATE_CHUNK_SHIFT) - 1) >> UPDATE_CHUNK_SHIFT;
+	n_intv = (bwt->seq_len + OCC_INTERVAL - 1) / OCC_INTERVAL;
+
+	// Adjust the FM-Index size by the number of interleaved occurrence counts
+	if (bwt->layout == BWT_LAYOUT_COMPACT) {
+		n_super = (bwt->seq_len + (1LL << BWT_COMPACT_SB_SHIFT) - 1) >> BWT_COMPACT_SB_SHIFT;
+		bwt->bwt_size = n_intv * BWT_COMPACT_INTV + n_super * BWT_COMPACT_SB;
+	}
+	else {
+		bwt->bwt_size += (n_intv + 1) * sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN;
+	}
+
+	worker.bwt = bwt;
+	worker.bwtBuf = allocBWT(bwt->bwt_size);
+	worker.chunkCounts = calloc((n_chunk + 1) * VALUE_DOMAIN, sizeof(int64_t));
+
+	// Occurrences before each chunk
+	kt_for(passThreads, countUpdateChunk, &worker, n_chunk);
+	for (i = n_chunk; i > 0; --i) {
+		memcpy(worker.chunkCounts + i * VALUE_DOMAIN, worker.chunkCounts + (i - 1) * VALUE_DOMAIN, VALUE_DOMAIN * sizeof(int64_t));
+	}
+	memset(worker.chunkCounts, 0, VALUE_DOMAIN * sizeof(int64_t));
+	for (i = 1; i <= n_chunk; ++i) {
+		for (c = 0; c < VALUE_DOMAIN; ++c) worker.chunkCounts[i * VALUE_DOMAIN + c] += worker.chunkCounts[(i - 1) * VALUE_DOMAIN + c];
+	}
+
+	kt_for(passThreads, fillUpdateChunk, &worker, n_chunk);
 
 	// Record last element
-	memcpy(bwtBuf + k, counts, sizeof(bwtint_t) * VALUE_DOMAIN);
-	xassert(k + sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN == bwt->bwt_size, "inconsistent bwt_size");
+	if (bwt->layout != BWT_LAYOUT_COMPACT) {
+		memcpy(worker.bwtBuf + bwt->bwt_size - sizeof(bwtint_t) / sizeof(uint32_t) * VALUE_DOMAIN, worker.chunkCounts + n_chunk * VALUE_DOMAIN, sizeof(bwtint_t) * VALUE_DOMAIN);
+	}
 
 	// Update FM-Index
+	free(worker.chunkCounts);
 	free(bwt->bwt);
-	bwt->bwt = bwtBuf;
+	bwt->bwt = worker.bwtBuf;
 }
 
 // 'bwtupdate' command entry point.
@@ -225,7 +374,7 @@ int command_bwtupdate(int argc, char *argv[]) {
 		return 1;
 	}
 	bwt = bwt_restore_bwt(argv[1]);
-	bwt_bwtupdate_core(bwt);
+	bwt_bwtupdate_core(bwt, 1);
 	bwt_dump_bwt(argv[1], bwt);
 	bwt_destroy(bwt);
 	return 0;
@@ -252,23 +401,82 @@ int command_bwt2sa(int argc, char *argv[]) {
 	return 0;
 }
 
-// 'index' command entry point.  Create protein file, pack, construct BWT, interleave, create SA, repack
+// Parse a memory size with an optional K, M or G suffix (bytes), returning -1 if malformed
+static int64_t parseMemSize(const char * passArg) {
+	char * suffix;
+	double ret;
+
+	ret = strtod(passArg, &suffix);
+	if (suffix == passArg || ret < 0) return -1;
+
+	switch (*suffix) {
+		case 'g': case 'G': ret *= 1024;
+		case 'm': case 'M': ret *= 1024;
+		case 'k': case 'K': ret *= 1024; suffix++;
+	}
+
+	return (*suffix) ? -1 : (int64_t) ret;
+}
+
+// Remove the .bwt, .sa, .kmer, .pac, .ann, .annb and .amb files of an index
+static void removeIndexFiles(const char * passPrefix) {
+	static const char * extensions[] = {".bwt", ".sa", ".kmer", ".pac", ".ann", ".annb", ".amb"};
+	char * name;
+	int idxExt;
+
+	name = malloc(strlen(passPrefix) + 6);
+	for (idxExt = 0 ; idxExt < sizeof(extensions) / sizeof(extensions[0]) ; idxExt++) {
+		sprintf(name, "%s%s", passPrefix, extensions[idxExt]);
+		unlink(name);
+	}
+	free(name);
+}
+
+// Replace the separate files of an index with a single .pidx container
+static void writeIndexContainer(const char * passPrefix) {
+	bwaidx_t * idx;
+
+	idx = index_load_from_disk(passPrefix, BWA_IDX_ALL);
+	if (!idx) err_fatal(__func__, "Failed to reload the index for '%s'", passPrefix);
+	index_dump_container(idx, passPrefix);
+	index_destroy(idx);
+
+	removeIndexFiles(passPrefix);
+}
+
+// 'index' command entry point.  Create protein file, pack, construct BWT and SA, interleave, all in memory
 int command_index(int argc, char *argv[]) {
 	bwt_t *bwt;
-	char * prefix, * proName, * pacName, * bwtName, * saName;
+	char * prefix, * proName, * bwtName, * saName, * kmerName;
+	ubyte_t * seq;
 	gzFile fp;
 	char c;
-	int indexType, valid;
+	int indexType, valid, threads, container, kmerLen, packedRef;
+	int64_t memBudget, seqLen;
 	IndexHeader indexHeader;
-	clock_t t;
+	double t, tCPU;
 
 	// Parse arguments
 	valid = 1;
 	indexType = -1;
+	memBudget = 0;
+	threads = 1;
+	container = 0;
+	kmerLen = 0;
+	packedRef = 0;
 	memset(&indexHeader, 0, sizeof(indexHeader));
+	indexHeader.saInterval = 32;
 
-	while ((c = getopt(argc, argv, "fr:p:")) >= 0) {
+	while ((c = getopt(argc, argv, "fcbr:p:l:Sm:t:k:s:")) >= 0) {
 		if (c == 'f') indexHeader.multiFrame = 1;
+		if (c == 'c') container = 1;
+		if (c == 'b') packedRef = 1;
+		if (c == 't') threads = atoi(optarg);
+		if (c == 'k') kmerLen = atoi(optarg);
+		if (c == 's') indexHeader.saInterval = atoi(optarg);
+		if (c == 'm') memBudget = parseMemSize(optarg);
+		if (c == 'S') indexHeader.singleStrand = 1;
+		if (c == 'l') indexHeader.occLayout = atoi(optarg);
 		if (c == 'p') indexHeader.referenceType = atoi(optarg);
 		if (c == 'r') indexType = atoi(optarg);
 		if (c == '?') valid = 0;
@@ -281,6 +489,11 @@ int command_index(int argc, char *argv[]) {
 		if ((indexType == 2) && (argc - optind == 1)) valid = 1;
 		if ((indexType == 3) && (argc - optind == 1)) valid = 1;
 		if ((indexType == 4) && (argc - optind == 1)) valid = 1;
+		if ((indexHeader.occLayout < BWT_LAYOUT_LEGACY) || (indexHeader.occLayout > BWT_LAYOUT_COMPACT)) valid = 0;
+		if (memBudget < 0) valid = 0;
+		if (threads < 1) valid = 0;
+		if ((kmerLen < 0) || (kmerLen > BWT_KMER_MAX)) valid = 0;
+		if ((indexHeader.saInterval < 1) || (indexHeader.saInterval & (indexHeader.saInterval - 1))) valid = 0;
 	}
 
 	if (!valid) {
@@ -292,7 +505,17 @@ int command_index(int argc, char *argv[]) {
 		fprintf(stderr, "              1: Reference contains nucleotide sequences (requires corresponding .gff annotation)\n");
 		fprintf(stderr, "              2: Reference contains nucleotide sequences (coding only, eg curated transcriptome)\n");
 		fprintf(stderr, "              3: Reference contains protein sequences (UniProt or other source)\n");
-		fprintf(stderr, "              4: Development tests\n\n");
+		fprintf(stderr, "              4: Development tests\n");
+		fprintf(stderr, "    -l<#>  Occurrence count layout:\n");
+		fprintf(stderr, "              0: 64-bit counts every 128 residues (default, readable by older versions)\n");
+		fprintf(stderr, "              1: Compact 16-bit counts with 64-bit superblocks (half the BWT size)\n");
+		fprintf(stderr, "    -S     Index the forward protein sequence only (half the BWT and SA, backward search seeding)\n");
+		fprintf(stderr, "    -m<#>  Memory budget for BWT construction, eg 16G (default unlimited, blockwise below ~11 bytes per residue, at least ~5)\n");
+		fprintf(stderr, "    -t<#>  Number of threads for BWT construction and occurrence counts (default 1)\n");
+		fprintf(stderr, "    -s<#>  Suffix array sample interval, a power of 2 (default 32; smaller for faster lookups, larger for a smaller .sa)\n");
+		fprintf(stderr, "    -k<#>  Depth of the k-mer interval table read by seeding instead of the first extensions (.kmer, up to %d, default 0: none)\n", BWT_KMER_MAX);
+		fprintf(stderr, "    -b     Pack the reference sequence (.pac) in 5 bits per residue instead of one byte\n");
+		fprintf(stderr, "    -c     Write a single page-aligned index container (.pidx) for memory-mapped loading\n\n");
 		fprintf(stderr, "Examples:\n\n");
 		fprintf(stderr, "   paladin index -r1 reference.fasta reference.gff\n");
 		fprintf(stderr, "   paladin index -r3 uniprot_sprot.fasta.gz\n");
@@ -303,18 +526,18 @@ int command_index(int argc, char *argv[]) {
 	// Setup filenames
 	prefix = malloc(strlen(argv[optind]) + 1);
 	proName = malloc(strlen(argv[optind]) + 5);
-	pacName = malloc(strlen(argv[optind]) + 5);
 	bwtName = malloc(strlen(argv[optind]) + 5);
 	saName = malloc(strlen(argv[optind]) + 5);
+	kmerName = malloc(strlen(argv[optind]) + 6);
 
 	sprintf(prefix, "%s", argv[optind]);
 	sprintf(proName, "%s.pro", argv[optind]);
-	sprintf(pacName, "%s.pac", argv[optind]);
 	sprintf(bwtName, "%s.bwt", argv[optind]);
 	sprintf(saName, "%s.sa", argv[optind]);
+	sprintf(kmerName, "%s.kmer", argv[optind]);
 
 	// Create Protein Sequence
-	t = clock();
+	t = realtime(); tCPU = cputime();
 	logMessage(__func__, LOG_LEVEL_MESSAGE, "Translating protein sequence...");
 
 	switch (indexType) {
@@ -334,55 +557,72 @@ int command_index(int argc, char *argv[]) {
 			writeIndexTestProtein(prefix, proName); break;
 	}
 
-	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec\n", (float)(clock() - t) / CLOCKS_PER_SEC);
+	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec, %.2f sec CPU\n", realtime() - t, cputime() - tCPU);
 
-	// Pack FASTA
+	// Pack FASTA once, writing the forward-only pac and keeping the indexed sequence (both strands unless single strand)
 	fp = xzopen(proName, "r");
-	t = clock();
+	t = realtime(); tCPU = cputime();
 	logMessage(__func__, LOG_LEVEL_MESSAGE, "Packing protein sequence... ");
-	bns_fasta2bntseq(fp, prefix, 0);
-	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec\n", (float)(clock() - t) / CLOCKS_PER_SEC);
+	seq = bns_fasta2pac(fp, prefix, indexHeader.singleStrand, packedRef, &seqLen);
+	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec, %.2f sec CPU\n", realtime() - t, cputime() - tCPU);
 	err_gzclose(fp);
 
-	// Construct BWT
-	t = clock();
-	logMessage(__func__, LOG_LEVEL_MESSAGE, "Constructing BWT for the packed sequence... ");
-	bwt = bwt_pac2bwt(pacName);
-	bwt_dump_bwt(bwtName, bwt);
-	bwt_destroy(bwt);
-	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec\n", (float)(clock() - t) / CLOCKS_PER_SEC);
+	// Construct BWT and sample the suffix array in the same pass
+	t = realtime(); tCPU = cputime();
+	logMessage(__func__, LOG_LEVEL_MESSAGE, "Constructing BWT and suffix array for the packed sequence... ");
+	bwt = bwt_seq2bwt(seq, seqLen, indexHeader.saInterval, memBudget, threads);
+	if (!bwt) {
+		// The budget is only known to be too small once the sequence is packed, so drop the files written so far
+		removeIndexFiles(prefix);
+		sprintf(proName, "%s.pro", prefix);
+		unlink(proName);
+		free(prefix);
+		free(proName);
+		free(bwtName);
+		free(saName);
+		free(kmerName);
+		return 1;
+	}
+	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec, %.2f sec CPU\n", realtime() - t, cputime() - tCPU);
 
 	// Update BWT
-	t = clock();
+	t = realtime(); tCPU = cputime();
 	logMessage(__func__, LOG_LEVEL_MESSAGE, "Updating BWT... ");
-	bwt = bwt_restore_bwt(bwtName);
-	bwt_bwtupdate_core(bwt);
-	bwt_dump_bwt(bwtName, bwt);
-	bwt_destroy(bwt);
-	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec\n", (float)(clock() - t) / CLOCKS_PER_SEC);
-
-	// Pack Forward-Only FASTA
-	fp = xzopen(proName, "r");
-	t = clock();
-	logMessage(__func__, LOG_LEVEL_MESSAGE, "Packing forward-only protein squence... ");
-	bns_fasta2bntseq(fp, prefix, 1);
-	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec\n", (float)(clock() - t) / CLOCKS_PER_SEC);
-	err_gzclose(fp);
+	bwt->layout = indexHeader.occLayout;
+	bwt_bwtupdate_core(bwt, threads);
+	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec, %.2f sec CPU\n", realtime() - t, cputime() - tCPU);
 
-	// Construct Suffix Array from FM-Index and Occurrences
-	t = clock();
-	logMessage(__func__, LOG_LEVEL_MESSAGE, "Constructing suffix array... ");
-	bwt = bwt_restore_bwt(bwtName);
-	bwt_cal_sa(bwt, 32);
+	// Write BWT and SA
+	t = realtime(); tCPU = cputime();
+	logMessage(__func__, LOG_LEVEL_MESSAGE, "Writing BWT and suffix array... ");
+	bwt_dump_bwt(bwtName, bwt);
 	bwt_dump_sa(saName, bwt);
+	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec, %.2f sec CPU\n", realtime() - t, cputime() - tCPU);
+
+	// Build the k-mer interval table, or drop one left by an earlier build
+	if (kmerLen) {
+		t = realtime(); tCPU = cputime();
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "Building k-mer interval table (depth %d)... ", kmerLen);
+		bwt_kmer_build(bwt, kmerLen, indexHeader.singleStrand);
+		bwt_dump_kmer(kmerName, bwt);
+		logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec, %.2f sec CPU\n", realtime() - t, cputime() - tCPU);
+	}
+	else unlink(kmerName);
 	bwt_destroy(bwt);
-	logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec\n", (float)(clock() - t) / CLOCKS_PER_SEC);
+
+	// Gather the separate index files into one container
+	if (container) {
+		t = realtime(); tCPU = cputime();
+		logMessage(__func__, LOG_LEVEL_MESSAGE, "Writing index container... ");
+		writeIndexContainer(prefix);
+		logMessageRaw(LOG_LEVEL_MESSAGE, "%.2f sec, %.2f sec CPU\n", realtime() - t, cputime() - tCPU);
+	}
 
 	free(prefix);
 	free(proName);
-	free(pacName);
 	free(bwtName);
 	free(saName);
+	free(kmerName);
 
 	return 0;
 }
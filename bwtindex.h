@@ -11,6 +11,9 @@ typedef struct {
 	int nucleotide;
 	int multiFrame;
 	int referenceType;
+	int occLayout;
+	int singleStrand;
+	int saInterval;
 	int version[3];
 } IndexHeader;
 
@@ -31,14 +34,19 @@ ubyte_t unpackValue(bwt_t * passBWT, int64_t passSeqIdx);
 // Obtain sequence length from the packed file
 int64_t bwa_seq_len(const char *fn_pac);
 
-// Populate the BWT from a packed file
-bwt_t * bwt_pac2bwt(const char *fn_pac);
+// Populate the BWT from an unpacked sequence (released here), sampling the suffix array every passSAIntv rows (0 to skip).
+// A non-zero passMemBudget (bytes) switches to blockwise construction when SA-IS would not fit in it, as do extra threads.
+// Returns 0 when the budget is too small even for that
+bwt_t * bwt_seq2bwt(ubyte_t * passSeq, int64_t passLen, int passSAIntv, int64_t passMemBudget, int passThreads);
+
+// Populate the BWT from a packed file, sampling the suffix array every passSAIntv rows (0 to skip)
+bwt_t * bwt_pac2bwt(const char *fn_pac, int passSAIntv, int64_t passMemBudget);
 
 // 'pac2bwt' command entry point. (Note: bwt generated at this step CANNOT be used with BWA, bwtupdate required)
 int command_pac2bwt(int argc, char *argv[]);
 
-// Interleave occurrence counts into the BWT at specified interval for efficient search
-void bwt_bwtupdate_core(bwt_t *bwt);
+// Interleave occurrence counts into the BWT at specified interval for efficient search, on passThreads threads
+void bwt_bwtupdate_core(bwt_t *bwt, int passThreads);
 
 // 'bwtupdate' command entry point.
 int command_bwtupdate(int argc, char *argv[]);
@@ -46,9 +54,12 @@ int command_bwtupdate(int argc, char *argv[]);
 // 'bwt2sa' command entry point.
 int command_bwt2sa(int argc, char *argv[]);
 
-// 'index' command entry point.  Create protein file, pack, construct BWT, interleave, create SA, repack
+// 'index' command entry point.  Create protein file, pack, construct BWT and SA, interleave, repack
 int command_index(int argc, char *argv[]);
 
 int64_t is_bwt(ubyte_t *T, int64_t n);
+int64_t is_bwt_sa(ubyte_t *T, int64_t n, int sa_intv, int64_t *sa);
+int64_t is_sa_int64(const int64_t *T, int64_t *SA, int64_t n, int64_t k);
+int64_t bwtgen_bwt_sa(const ubyte_t *T, int64_t n, uint32_t *B, int sa_intv, int64_t *sa, int64_t mem, int n_threads);
 
 #endif /* BWTINDEX_H_ */
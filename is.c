@@ -201,12 +201,33 @@ int64_t is_sa(const ubyte_t *T, int64_t *SA, int64_t n)
 }
 
 /**
- * Constructs the burrows-wheeler transformed string of a given string.
+ * Constructs the suffix array of a given integer string.
+ * @param T[0..n-1] The input string, with values in {0..k-1}.
+ * @param SA[0..n-1] The output array of suffixes (without the empty suffix).
+ * @param n The length of the given string.
+ * @param k The alphabet size.
+ * @return 0 if no error occurred
+ */
+int64_t is_sa_int64(const int64_t *T, int64_t *SA, int64_t n, int64_t k)
+{
+	if ((T == NULL) || (SA == NULL) || (n < 0)) return -1;
+	if (n <= 1) {
+		if (n == 1) SA[0] = 0;
+		return 0;
+	}
+	return sais_main((const unsigned char *) T, SA, 0, n, k, sizeof(int64_t));
+}
+
+/**
+ * Constructs the burrows-wheeler transformed string of a given string, keeping every sa_intv-th
+ * suffix array value on the way.
  * @param T[0..n-1] The input string.
  * @param n The length of the given string.
+ * @param sa_intv The sampling interval (0 to keep none).
+ * @param sa[0..n/sa_intv] The sampled suffix array, SA[i*sa_intv] (SA[0] is the position of $, n).
  * @return The primary index if no error occurred, -1 or -2 otherwise.
  */
-int64_t is_bwt(ubyte_t *T, int64_t n)
+int64_t is_bwt_sa(ubyte_t *T, int64_t n, int sa_intv, int64_t *sa)
 {
 	int64_t *SA, i, primary = 0;
 	SA = (int64_t *)calloc(n+1, sizeof(int64_t));
@@ -214,6 +235,7 @@ int64_t is_bwt(ubyte_t *T, int64_t n)
 	if (is_sa(T, SA, n)) return -1;
 
 	for (i = 0; i <= n; ++i) {
+		if (sa_intv && i % sa_intv == 0) sa[i / sa_intv] = SA[i];
 		if (SA[i] == 0) primary = i;
 		else SA[i] = T[SA[i] - 1];
 	}
@@ -222,3 +244,14 @@ int64_t is_bwt(ubyte_t *T, int64_t n)
 	free(SA);
 	return primary;
 }
+
+/**
+ * Constructs the burrows-wheeler transformed string of a given string.
+ * @param T[0..n-1] The input string.
+ * @param n The length of the given string.
+ * @return The primary index if no error occurred, -1 or -2 otherwise.
+ */
+int64_t is_bwt(ubyte_t *T, int64_t n)
+{
+	return is_bwt_sa(T, n, 0, 0);
+}
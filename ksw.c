@@ -26,10 +26,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <emmintrin.h>
 #include "ksw.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define KSW_EXT_X86
+#  include <immintrin.h>
+#endif
+
 #ifdef USE_MALLOC_WRAPPERS
 #  include "malloc_wrap.h"
 #endif
@@ -45,11 +52,13 @@
 const kswr_t g_defr = { 0, -1, -1, -1, -1, -1, -1 };
 
 struct _kswq_t {
-	int qlen, slen;
-	uint8_t shift, mdiff, max, size;
-	__m128i *qp, *H0, *H1, *E, *Hmax;
+	int qlen, slen, jb;
+	uint8_t shift, mdiff, max, size, kernel; // kernel the profile is laid out for (KSW_ALIGN_*)
+	__m128i *qp, *H0, *H1, *E, *Hmax, *mask; // vectors of 16 << (kernel - 1) bytes
 };
 
+static int ksw_align_kernel = -1, ksw_align_supported; // selected kernel, or -1 before the first profile
+
 /**
  * Initialize the query data structure
  *
@@ -64,18 +73,34 @@ struct _kswq_t {
 kswq_t *ksw_qinit(int size, int qlen, const uint8_t *query, int m, const int8_t *mat)
 {
 	kswq_t *q;
-	int slen, a, tmp, p;
+	int slen, a, tmp, p, vn, kernel;
 
+	if (ksw_align_kernel < 0) ksw_align_select(KSW_ALIGN_AUTO); // every thread resolves to the same kernel, so the race is benign
 	size = size > 1? 2 : 1;
-	p = 8 * (3 - size); // # values per __m128i
+	// Wider vectors only pay off once each lane has a few segments: the lazy-F loop makes one pass per
+	// lane, and short queries fill few of them (see 'paladin bench sw'). AVX-512 rarely beats AVX2 there
+	kernel = ksw_align_kernel;
+	if (kernel == KSW_ALIGN_AUTO)
+		kernel = ksw_align_supported >= KSW_ALIGN_AVX2 && qlen >= 3 * 32 / size? KSW_ALIGN_AVX2 : KSW_ALIGN_SSE2;
+	vn = 1 << (kernel - 1); // # __m128i per vector
+	p = 8 * (3 - size) * vn; // # values per vector
 	slen = (qlen + p - 1) / p; // segmented length
-	q = (kswq_t*)malloc(sizeof(kswq_t) + 256 + 16 * slen * (m + 4)); // a single block of memory
-	q->qp = (__m128i*)(((size_t)q + sizeof(kswq_t) + 15) >> 4 << 4); // align memory
-	q->H0 = q->qp + slen * m;
-	q->H1 = q->H0 + slen;
-	q->E  = q->H1 + slen;
-	q->Hmax = q->E + slen;
-	q->slen = slen; q->qlen = qlen; q->size = size;
+	q = (kswq_t*)malloc(sizeof(kswq_t) + 256 + 16 * vn * (slen * (m + 4) + 2)); // a single block of memory
+	q->qp = (__m128i*)(((size_t)q + sizeof(kswq_t) + 63) >> 6 << 6); // align memory
+	q->H0 = q->qp + vn * slen * m;
+	q->H1 = q->H0 + vn * slen;
+	q->E  = q->H1 + vn * slen;
+	q->Hmax = q->E + vn * slen;
+	q->mask = q->Hmax + vn * slen;
+	q->slen = slen; q->qlen = qlen; q->size = size; q->kernel = kernel;
+	// Positions past qlen pad the last lanes and are kept out of the row maxima, which feed score2/te2:
+	// lanes up to tmp hold the query in segments before jb, lanes below it after
+	tmp = slen? qlen / slen : 0;
+	q->jb = qlen - tmp * slen;
+	for (a = 0; a < p; ++a) {
+		memset((uint8_t*)q->mask + a * size, a <= tmp? 0xff : 0, size);
+		memset((uint8_t*)q->mask + (p + a) * size, a < tmp? 0xff : 0, size);
+	}
 	// compute shift
 	tmp = m * m;
 	for (a = 0, q->shift = 127, q->mdiff = 0; a < tmp; ++a) { // find the minimum and maximum score
@@ -145,10 +170,11 @@ kswr_t ksw_u8(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_del
 	// the core loop
 	for (i = 0; i < tlen; ++i) {
 		int j, k, cmp, imax;
-		__m128i e, h, t, f = zero, max = zero, *S = q->qp + target[i] * slen; // s is the 1st score vector
+		__m128i e, h, t, f = zero, max = zero, maxa = zero, *S = q->qp + target[i] * slen; // s is the 1st score vector
 		h = _mm_load_si128(H0 + slen - 1); // h={2,5,8,11,14,17,-1,-1} in the above example
 		h = _mm_slli_si128(h, 1); // h=H(i-1,-1); << instead of >> because x64 is little-endian
 		for (j = 0; LIKELY(j < slen); ++j) {
+			if (j == q->jb) maxa = max, max = zero; // one more lane is padding from here on
 			/* SW cells are computed in the following order:
 			 *   H(i,j)   = max{H(i-1,j-1)+S(i,j), E(i,j), F(i,j)}
 			 *   E(i+1,j) = max{H(i,j)-q, E(i,j)-r}
@@ -179,16 +205,17 @@ kswr_t ksw_u8(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_del
 			f = _mm_slli_si128(f, 1);
 			for (j = 0; LIKELY(j < slen); ++j) {
 				h = _mm_load_si128(H1 + j);
+				t = _mm_subs_epu8(h, oe_ins); // tested before the update, or F stops at the first cell it raises when _o_ins == 0
 				h = _mm_max_epu8(h, f); // h=H'(i,j)
 				_mm_store_si128(H1 + j, h);
-				h = _mm_subs_epu8(h, oe_ins);
 				f = _mm_subs_epu8(f, e_ins);
-				cmp = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(f, h), zero));
+				cmp = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(f, t), zero));
 				if (UNLIKELY(cmp == 0xffff)) goto end_loop16;
 			}
 		}
 end_loop16:
 		//int k;for (k=0;k<16;++k)printf("%d ", ((uint8_t*)&max)[k]);printf("\n");
+		max = _mm_max_epu8(_mm_and_si128(maxa, q->mask[0]), _mm_and_si128(max, q->mask[1]));
 		__max_16(imax, max); // imax is the maximum number in max
 		if (imax >= minsc) { // write the b array; this condition adds branching unfornately
 			if (n_b == 0 || (int32_t)b[n_b-1] + 1 != i) { // then append
@@ -264,10 +291,11 @@ kswr_t ksw_i16(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_de
 	// the core loop
 	for (i = 0; i < tlen; ++i) {
 		int j, k, imax;
-		__m128i e, t, h, f = zero, max = zero, *S = q->qp + target[i] * slen; // s is the 1st score vector
+		__m128i e, t, h, f = zero, max = zero, maxa = zero, *S = q->qp + target[i] * slen; // s is the 1st score vector
 		h = _mm_load_si128(H0 + slen - 1); // h={2,5,8,11,14,17,-1,-1} in the above example
 		h = _mm_slli_si128(h, 2);
 		for (j = 0; LIKELY(j < slen); ++j) {
+			if (j == q->jb) maxa = max, max = zero;
 			h = _mm_adds_epi16(h, *S++);
 			e = _mm_load_si128(E + j);
 			h = _mm_max_epi16(h, e);
@@ -287,14 +315,15 @@ kswr_t ksw_i16(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_de
 			f = _mm_slli_si128(f, 2);
 			for (j = 0; LIKELY(j < slen); ++j) {
 				h = _mm_load_si128(H1 + j);
+				t = _mm_subs_epu16(h, oe_ins);
 				h = _mm_max_epi16(h, f);
 				_mm_store_si128(H1 + j, h);
-				h = _mm_subs_epu16(h, oe_ins);
 				f = _mm_subs_epu16(f, e_ins);
-				if(UNLIKELY(!_mm_movemask_epi8(_mm_cmpgt_epi16(f, h)))) goto end_loop8;
+				if(UNLIKELY(!_mm_movemask_epi8(_mm_cmpgt_epi16(f, t)))) goto end_loop8;
 			}
 		}
 end_loop8:
+		max = _mm_max_epi16(_mm_and_si128(maxa, q->mask[0]), _mm_and_si128(max, q->mask[1]));
 		__max_8(imax, max);
 		if (imax >= minsc) {
 			if (n_b == 0 || (int32_t)b[n_b-1] + 1 != i) {
@@ -334,6 +363,393 @@ end_loop8:
 	return r;
 }
 
+/* Wider builds of ksw_u8() and ksw_i16(): the same striped loop on 256 or 512-bit vectors, so each row takes
+ * a half or a quarter of the segments. The query profile is laid out by ksw_qinit() for the kernel selected
+ * when it is built, and ksw_align2() runs the kernel the profile was made for. Cells hold the same values
+ * at every width (only their lanes change), so the results are identical to the SSE2 kernels; the lazy-F
+ * loop needs one pass per lane to carry F across the whole vector. */
+
+#ifdef KSW_EXT_X86
+
+#define KSW_U8_BODY(L) \
+	int slen, i, m_b, n_b, te = -1, gmax = 0, minsc, endsc; \
+	uint64_t *b; \
+	V zero, oe_del, e_del, oe_ins, e_ins, shift, *H0, *H1, *E, *Hmax, *qp; \
+	kswr_t r; \
+	r = g_defr; \
+	minsc = (xtra&KSW_XSUBO)? xtra&0xffff : 0x10000; \
+	endsc = (xtra&KSW_XSTOP)? xtra&0xffff : 0x10000; \
+	m_b = n_b = 0; b = 0; \
+	zero = V_ZERO; \
+	oe_del = V_SET1(_o_del + _e_del); \
+	e_del = V_SET1(_e_del); \
+	oe_ins = V_SET1(_o_ins + _e_ins); \
+	e_ins = V_SET1(_e_ins); \
+	shift = V_SET1(q->shift); \
+	H0 = (V*)q->H0; H1 = (V*)q->H1; E = (V*)q->E; Hmax = (V*)q->Hmax; qp = (V*)q->qp; \
+	slen = q->slen; \
+	for (i = 0; i < slen; ++i) { \
+		V_STORE(E + i, zero); \
+		V_STORE(H0 + i, zero); \
+		V_STORE(Hmax + i, zero); \
+	} \
+	for (i = 0; i < tlen; ++i) { \
+		int j, k, imax; \
+		V e, h, t, f = zero, max = zero, maxa = zero, *S = qp + target[i] * slen; \
+		h = V_LOAD(H0 + slen - 1); \
+		h = V_SHL(h, 1); \
+		for (j = 0; LIKELY(j < slen); ++j) { \
+			if (j == q->jb) maxa = max, max = zero; \
+			h = V_ADDS(h, V_LOAD(S + j)); \
+			h = V_SUBS(h, shift); \
+			e = V_LOAD(E + j); \
+			h = V_MAX(h, e); \
+			h = V_MAX(h, f); \
+			max = V_MAX(max, h); \
+			V_STORE(H1 + j, h); \
+			e = V_SUBS(e, e_del); \
+			t = V_SUBS(h, oe_del); \
+			e = V_MAX(e, t); \
+			V_STORE(E + j, e); \
+			f = V_SUBS(f, e_ins); \
+			t = V_SUBS(h, oe_ins); \
+			f = V_MAX(f, t); \
+			h = V_LOAD(H0 + j); \
+		} \
+		for (k = 0; LIKELY(k < L); ++k) { \
+			f = V_SHL(f, 1); \
+			for (j = 0; LIKELY(j < slen); ++j) { \
+				h = V_LOAD(H1 + j); \
+				t = V_SUBS(h, oe_ins); \
+				h = V_MAX(h, f); \
+				V_STORE(H1 + j, h); \
+				f = V_SUBS(f, e_ins); \
+				if (UNLIKELY(V_ZEROS(V_SUBS(f, t)))) goto end_loop; \
+			} \
+		} \
+end_loop: \
+		imax = V_HMAX(V_MAX(V_AND(maxa, V_LOAD((V*)q->mask)), V_AND(max, V_LOAD((V*)q->mask + 1)))); \
+		if (imax >= minsc) { \
+			if (n_b == 0 || (int32_t)b[n_b-1] + 1 != i) { \
+				if (n_b == m_b) { \
+					m_b = m_b? m_b<<1 : 8; \
+					b = (uint64_t*)realloc(b, 8 * m_b); \
+				} \
+				b[n_b++] = (uint64_t)imax<<32 | i; \
+			} else if ((int)(b[n_b-1]>>32) < imax) b[n_b-1] = (uint64_t)imax<<32 | i; \
+		} \
+		if (imax > gmax) { \
+			gmax = imax; te = i; \
+			for (j = 0; LIKELY(j < slen); ++j) \
+				V_STORE(Hmax + j, V_LOAD(H1 + j)); \
+			if (gmax + q->shift >= 255 || gmax >= endsc) break; \
+		} \
+		S = H1; H1 = H0; H0 = S; \
+	} \
+	r.score = gmax + q->shift < 255? gmax : 255; \
+	r.te = te; \
+	if (r.score != 255) { \
+		int max = -1, tmp, low, high, qlen = slen * L; \
+		uint8_t *t = (uint8_t*)Hmax; \
+		for (i = 0; i < qlen; ++i, ++t) \
+			if ((int)*t > max) max = *t, r.qe = i / L + i % L * slen; \
+			else if ((int)*t == max && (tmp = i / L + i % L * slen) < r.qe) r.qe = tmp; \
+		if (b) { \
+			i = (r.score + q->max - 1) / q->max; \
+			low = te - i; high = te + i; \
+			for (i = 0; i < n_b; ++i) { \
+				int e = (int32_t)b[i]; \
+				if ((e < low || e > high) && (int)(b[i]>>32) > r.score2) \
+					r.score2 = b[i]>>32, r.te2 = e; \
+			} \
+		} \
+	} \
+	free(b); \
+	return r;
+
+// As KSW_U8_BODY, with signed 16-bit cells and an unbiased profile
+#define KSW_I16_BODY(L) \
+	int slen, i, m_b, n_b, te = -1, gmax = 0, minsc, endsc; \
+	uint64_t *b; \
+	V zero, oe_del, e_del, oe_ins, e_ins, *H0, *H1, *E, *Hmax, *qp; \
+	kswr_t r; \
+	r = g_defr; \
+	minsc = (xtra&KSW_XSUBO)? xtra&0xffff : 0x10000; \
+	endsc = (xtra&KSW_XSTOP)? xtra&0xffff : 0x10000; \
+	m_b = n_b = 0; b = 0; \
+	zero = V_ZERO; \
+	oe_del = V_SET1(_o_del + _e_del); \
+	e_del = V_SET1(_e_del); \
+	oe_ins = V_SET1(_o_ins + _e_ins); \
+	e_ins = V_SET1(_e_ins); \
+	H0 = (V*)q->H0; H1 = (V*)q->H1; E = (V*)q->E; Hmax = (V*)q->Hmax; qp = (V*)q->qp; \
+	slen = q->slen; \
+	for (i = 0; i < slen; ++i) { \
+		V_STORE(E + i, zero); \
+		V_STORE(H0 + i, zero); \
+		V_STORE(Hmax + i, zero); \
+	} \
+	for (i = 0; i < tlen; ++i) { \
+		int j, k, imax; \
+		V e, t, h, f = zero, max = zero, maxa = zero, *S = qp + target[i] * slen; \
+		h = V_LOAD(H0 + slen - 1); \
+		h = V_SHL(h, 1); \
+		for (j = 0; LIKELY(j < slen); ++j) { \
+			if (j == q->jb) maxa = max, max = zero; \
+			h = V_ADDS(h, V_LOAD(S + j)); \
+			e = V_LOAD(E + j); \
+			h = V_MAX(h, e); \
+			h = V_MAX(h, f); \
+			max = V_MAX(max, h); \
+			V_STORE(H1 + j, h); \
+			e = V_SUBS(e, e_del); \
+			t = V_SUBS(h, oe_del); \
+			e = V_MAX(e, t); \
+			V_STORE(E + j, e); \
+			f = V_SUBS(f, e_ins); \
+			t = V_SUBS(h, oe_ins); \
+			f = V_MAX(f, t); \
+			h = V_LOAD(H0 + j); \
+		} \
+		for (k = 0; LIKELY(k < (L > 16? L : 16)); ++k) { \
+			f = V_SHL(f, 1); \
+			for (j = 0; LIKELY(j < slen); ++j) { \
+				h = V_LOAD(H1 + j); \
+				t = V_SUBS(h, oe_ins); \
+				h = V_MAX(h, f); \
+				V_STORE(H1 + j, h); \
+				f = V_SUBS(f, e_ins); \
+				if (UNLIKELY(V_ZEROS(V_SUBS(f, t)))) goto end_loop; \
+			} \
+		} \
+end_loop: \
+		imax = V_HMAX(V_MAX(V_AND(maxa, V_LOAD((V*)q->mask)), V_AND(max, V_LOAD((V*)q->mask + 1)))); \
+		if (imax >= minsc) { \
+			if (n_b == 0 || (int32_t)b[n_b-1] + 1 != i) { \
+				if (n_b == m_b) { \
+					m_b = m_b? m_b<<1 : 8; \
+					b = (uint64_t*)realloc(b, 8 * m_b); \
+				} \
+				b[n_b++] = (uint64_t)imax<<32 | i; \
+			} else if ((int)(b[n_b-1]>>32) < imax) b[n_b-1] = (uint64_t)imax<<32 | i; \
+		} \
+		if (imax > gmax) { \
+			gmax = imax; te = i; \
+			for (j = 0; LIKELY(j < slen); ++j) \
+				V_STORE(Hmax + j, V_LOAD(H1 + j)); \
+			if (gmax >= endsc) break; \
+		} \
+		S = H1; H1 = H0; H0 = S; \
+	} \
+	r.score = gmax; r.te = te; \
+	{ \
+		int max = -1, tmp, low, high, qlen = slen * L; \
+		uint16_t *t = (uint16_t*)Hmax; \
+		for (i = 0, r.qe = -1; i < qlen; ++i, ++t) \
+			if ((int)*t > max) max = *t, r.qe = i / L + i % L * slen; \
+			else if ((int)*t == max && (tmp = i / L + i % L * slen) < r.qe) r.qe = tmp; \
+		if (b) { \
+			i = (r.score + q->max - 1) / q->max; \
+			low = te - i; high = te + i; \
+			for (i = 0; i < n_b; ++i) { \
+				int e = (int32_t)b[i]; \
+				if ((e < low || e > high) && (int)(b[i]>>32) > r.score2) \
+					r.score2 = b[i]>>32, r.te2 = e; \
+			} \
+		} \
+	} \
+	free(b); \
+	return r;
+
+// Shift left by n bytes across the two 128-bit halves
+#define ksw_shl256(x, n) ((n) < 16? _mm256_alignr_epi8(x, _mm256_permute2x128_si256(x, x, 0x08), 16 - (n)) : _mm256_permute2x128_si256(x, x, 0x08))
+
+__attribute__((target("avx2")))
+static inline int ksw_hmax_u8_avx2(__m256i x)
+{
+	__m128i y = _mm_max_epu8(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+	y = _mm_max_epu8(y, _mm_srli_si128(y, 8));
+	y = _mm_max_epu8(y, _mm_srli_si128(y, 4));
+	y = _mm_max_epu8(y, _mm_srli_si128(y, 2));
+	y = _mm_max_epu8(y, _mm_srli_si128(y, 1));
+	return _mm_extract_epi16(y, 0) & 0x00ff;
+}
+
+__attribute__((target("avx2")))
+static inline int ksw_hmax_i16_avx2(__m256i x)
+{
+	__m128i y = _mm_max_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+	y = _mm_max_epi16(y, _mm_srli_si128(y, 8));
+	y = _mm_max_epi16(y, _mm_srli_si128(y, 4));
+	y = _mm_max_epi16(y, _mm_srli_si128(y, 2));
+	return (int16_t)_mm_extract_epi16(y, 0);
+}
+
+#define V __m256i
+#define V_ZERO _mm256_setzero_si256()
+#define V_LOAD(p) _mm256_load_si256(p)
+#define V_STORE(p, x) _mm256_store_si256(p, x)
+#define V_ZEROS(x) _mm256_testz_si256(x, x)
+#define V_AND _mm256_and_si256
+
+#define V_SET1 _mm256_set1_epi8
+#define V_ADDS _mm256_adds_epu8
+#define V_SUBS _mm256_subs_epu8
+#define V_MAX _mm256_max_epu8
+#define V_SHL(x, n) ksw_shl256(x, n)
+#define V_HMAX ksw_hmax_u8_avx2
+
+__attribute__((target("avx2")))
+static kswr_t ksw_u8_avx2(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_del, int _o_ins, int _e_ins, int xtra)
+{
+	KSW_U8_BODY(32)
+}
+
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHL
+#undef V_HMAX
+#define V_SET1 _mm256_set1_epi16
+#define V_ADDS _mm256_adds_epi16
+#define V_SUBS _mm256_subs_epu16
+#define V_MAX _mm256_max_epi16
+#define V_SHL(x, n) ksw_shl256(x, (n) * 2)
+#define V_HMAX ksw_hmax_i16_avx2
+
+__attribute__((target("avx2")))
+static kswr_t ksw_i16_avx2(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_del, int _o_ins, int _e_ins, int xtra)
+{
+	KSW_I16_BODY(16)
+}
+
+#undef V
+#undef V_ZERO
+#undef V_LOAD
+#undef V_STORE
+#undef V_ZEROS
+#undef V_AND
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHL
+#undef V_HMAX
+
+// Shift left by n < 16 bytes across the four 128-bit lanes: each lane takes its top bytes from the lane below
+#define ksw_shl512(x, n) _mm512_alignr_epi8(x, _mm512_maskz_shuffle_i64x2(0xfc, x, x, 0x90), 16 - (n))
+
+__attribute__((target("avx512bw")))
+static inline int ksw_hmax_u8_avx512(__m512i x)
+{
+	return ksw_hmax_u8_avx2(_mm256_max_epu8(_mm512_castsi512_si256(x), _mm512_extracti64x4_epi64(x, 1)));
+}
+
+__attribute__((target("avx512bw")))
+static inline int ksw_hmax_i16_avx512(__m512i x)
+{
+	return ksw_hmax_i16_avx2(_mm256_max_epi16(_mm512_castsi512_si256(x), _mm512_extracti64x4_epi64(x, 1)));
+}
+
+#define V __m512i
+#define V_ZERO _mm512_setzero_si512()
+#define V_LOAD(p) _mm512_load_si512(p)
+#define V_STORE(p, x) _mm512_store_si512(p, x)
+#define V_ZEROS(x) (_mm512_test_epi64_mask(x, x) == 0)
+#define V_AND _mm512_and_si512
+
+#define V_SET1 _mm512_set1_epi8
+#define V_ADDS _mm512_adds_epu8
+#define V_SUBS _mm512_subs_epu8
+#define V_MAX _mm512_max_epu8
+#define V_SHL(x, n) ksw_shl512(x, n)
+#define V_HMAX ksw_hmax_u8_avx512
+
+__attribute__((target("avx512bw")))
+static kswr_t ksw_u8_avx512(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_del, int _o_ins, int _e_ins, int xtra)
+{
+	KSW_U8_BODY(64)
+}
+
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHL
+#undef V_HMAX
+#define V_SET1 _mm512_set1_epi16
+#define V_ADDS _mm512_adds_epi16
+#define V_SUBS _mm512_subs_epu16
+#define V_MAX _mm512_max_epi16
+#define V_SHL(x, n) ksw_shl512(x, (n) * 2)
+#define V_HMAX ksw_hmax_i16_avx512
+
+__attribute__((target("avx512bw")))
+static kswr_t ksw_i16_avx512(kswq_t *q, int tlen, const uint8_t *target, int _o_del, int _e_del, int _o_ins, int _e_ins, int xtra)
+{
+	KSW_I16_BODY(32)
+}
+
+#undef V
+#undef V_ZERO
+#undef V_LOAD
+#undef V_STORE
+#undef V_ZEROS
+#undef V_AND
+#undef V_SET1
+#undef V_ADDS
+#undef V_SUBS
+#undef V_MAX
+#undef V_SHL
+#undef V_HMAX
+
+#endif // KSW_EXT_X86
+
+typedef kswr_t (*ksw_align_f)(kswq_t*, int, const uint8_t*, int, int, int, int, int);
+
+// Kernels by profile layout (KSW_ALIGN_*) and cell size
+static ksw_align_f ksw_align_funcs[4][2] = {
+	{ 0, 0 },
+	{ ksw_u8, ksw_i16 },
+#ifdef KSW_EXT_X86
+	{ ksw_u8_avx2, ksw_i16_avx2 },
+	{ ksw_u8_avx512, ksw_i16_avx512 }
+#endif
+};
+
+const char *ksw_align_name(int kernel)
+{
+	switch (kernel) {
+		case KSW_ALIGN_SSE2: return "sse2";
+		case KSW_ALIGN_AVX2: return "avx2";
+		case KSW_ALIGN_AVX512: return "avx512bw";
+		default: return "auto";
+	}
+}
+
+int ksw_align_select(int kernel)
+{
+	int supported = KSW_ALIGN_SSE2;
+	const char *env;
+
+#ifdef KSW_EXT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) supported = KSW_ALIGN_AVX2;
+	if (supported == KSW_ALIGN_AVX2 && __builtin_cpu_supports("avx512bw")) supported = KSW_ALIGN_AVX512;
+#endif
+
+	if (kernel < KSW_ALIGN_AUTO || kernel > supported) return -1;
+	if (kernel == KSW_ALIGN_AUTO && (env = getenv("PALADIN_KSW_ALIGN")) != 0) { // forced for benchmarking; ignored when not supported
+		int k;
+		for (k = KSW_ALIGN_SSE2; k <= supported; ++k)
+			if (strcmp(env, ksw_align_name(k)) == 0) kernel = k;
+	}
+	ksw_align_supported = supported;
+
+	return ksw_align_kernel = kernel;
+}
+
 static inline void revseq(int l, uint8_t *s)
 {
 	int i, t;
@@ -350,13 +766,14 @@ kswr_t ksw_align2(int qlen, uint8_t *query, int tlen, uint8_t *target, int m, co
 
 	q = (qry && *qry)? *qry : ksw_qinit((xtra&KSW_XBYTE)? 1 : 2, qlen, query, m, mat);
 	if (qry && *qry == 0) *qry = q;
-	func = q->size == 2? ksw_i16 : ksw_u8;
+	func = ksw_align_funcs[q->kernel][q->size == 2];
 	size = q->size;
 	r = func(q, tlen, target, o_del, e_del, o_ins, e_ins, xtra);
 	if (qry == 0) free(q);
 	if ((xtra&KSW_XSTART) == 0 || ((xtra&KSW_XSUBO) && r.score < (xtra&0xffff))) return r;
 	revseq(r.qe + 1, query); revseq(r.te + 1, target); // +1 because qe/te points to the exact end, not the position after the end
 	q = ksw_qinit(size, r.qe + 1, query, m, mat);
+	func = ksw_align_funcs[q->kernel][q->size == 2];
 	rr = func(q, tlen, target, o_del, e_del, o_ins, e_ins, KSW_XSTOP | r.score);
 	revseq(r.qe + 1, query); revseq(r.te + 1, target);
 	free(q);
@@ -378,11 +795,12 @@ typedef struct {
 	int32_t h, e;
 } eh_t;
 
-int ksw_extend2(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int *_qle, int *_tle, int *_gtle, int *_gscore, int *_max_off)
+// With rev set, query and target are read from their last residue backwards, as on reversed copies
+static inline int ksw_extend_core(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *_qle, int *_tle, int *_gtle, int *_gscore, int *_max_off, int *_cells)
 {
 	eh_t *eh; // score array
 	int8_t *qp; // query profile
-	int i, j, k, oe_del = o_del + e_del, oe_ins = o_ins + e_ins, beg, end, max, max_i, max_j, max_ins, max_del, max_ie, gscore, max_off;
+	int i, j, k, oe_del = o_del + e_del, oe_ins = o_ins + e_ins, beg, end, max, max_i, max_j, max_ins, max_del, max_ie, gscore, max_off, cells = 0;
 	assert(h0 > 0);
 
 	// allocate memory
@@ -392,7 +810,8 @@ int ksw_extend2(int qlen, const uint8_t *query, int tlen, const uint8_t *target,
 	// generate the query profile
 	for (k = i = 0; k < m; ++k) {
 		const int8_t *p = &mat[k * m];
-		for (j = 0; j < qlen; ++j) qp[i++] = p[query[j]];
+		if (rev) for (j = qlen - 1; j >= 0; --j) qp[i++] = p[query[j]];
+		else for (j = 0; j < qlen; ++j) qp[i++] = p[query[j]];
 	}
 
 	// fill the first row
@@ -417,12 +836,13 @@ int ksw_extend2(int qlen, const uint8_t *query, int tlen, const uint8_t *target,
 	beg = 0, end = qlen;
 	for (i = 0; LIKELY(i < tlen); ++i) {
 		int t, f = 0, h1, m = 0, mj = -1;
-		int8_t *q = &qp[target[i] * qlen];
+		int8_t *q = &qp[target[rev? tlen - 1 - i : i] * qlen];
 
 		// apply the band and the constraint (if provided)
 		if (beg < i - w) beg = i - w;
 		if (end > i + w + 1) end = i + w + 1;
 		if (end > qlen) end = qlen;
+		cells += beg < end? end - beg : 0;
 
 		// compute the first column
 		if (beg == 0) {
@@ -463,6 +883,10 @@ int ksw_extend2(int qlen, const uint8_t *query, int tlen, const uint8_t *target,
 		if (m > max) {
 			max = m, max_i = i, max_j = mj;
 			max_off = max_off > abs(mj - i)? max_off : abs(mj - i);
+			if (max_off >= wide_off && max > wide_sc) { // the caller will retry with a wider band anyway
+				max = KSW_EXT_WIDER;
+				break;
+			}
 		} else if (zdrop > 0) {
 			if (i - max_i > mj - max_j) {
 				if (max - m - ((i - max_i) - (mj - max_j)) * e_del > zdrop) break;
@@ -483,9 +907,423 @@ int ksw_extend2(int qlen, const uint8_t *query, int tlen, const uint8_t *target,
 	if (_gtle) *_gtle = max_ie + 1;
 	if (_gscore) *_gscore = gscore;
 	if (_max_off) *_max_off = max_off;
+	if (_cells) *_cells = cells;
 	return max;
 }
 
+/*****************************
+ *** SIMD banded extension ***
+ *****************************/
+
+/* The kernels below compute each row of ksw_extend_core() with vectors and leave the rest of the loop (band,
+ * z-drop, maxima and the band trimming) in scalar code, so the results are identical. Within a row only F
+ * depends on the cells to its left, and as it is taken from M rather than H it is a running maximum of
+ * max(M - oe_ins, 0) decaying by e_ins per column, computed with a log-step scan. Scores go in unsigned
+ * bytes when the best possible score fits (the profile is then biased to be non-negative), or else in 16-bit
+ * lanes; extensions that may exceed 16 bits use the scalar kernel. */
+
+#ifdef KSW_EXT_X86
+
+// Row i over [beg, end): hp[j] holds H(i-1,j-1) and becomes H(i,j-1), ep[j] holds E(i,j) and becomes E(i+1,j).
+// Columns after end are left alone, except hp[end] = H(i,end-1) and ep[end] = 0 as in the scalar loop.
+// Returns the row maximum, its last column in *mj and H(i,end-1) in *hl (h1 when the row is empty)
+typedef int (*ksw_row_f)(const void *qrow, void *hp, void *ep, int beg, int end, int h1, int bias, int e_del, int oe_del, int e_ins, int oe_ins, int *mj, int *hl);
+
+#define KSW_ROW_BODY(T, L) \
+	const T *q_ = (const T*)qrow; \
+	T *hp_ = (T*)hp, *ep_ = (T*)ep; \
+	T tmp[L] __attribute__((aligned(32))); \
+	V zero = V_ZERO, vbias = V_SET1(bias), ve_del = V_SET1(e_del), voe_del = V_SET1(oe_del), ve_ins = V_SET1(e_ins), voe_ins = V_SET1(oe_ins), vidx = V_IDX, vm = zero; \
+	int j, fc = 0, hc = h1, m = 0; \
+	*hl = h1; \
+	for (j = beg; j < end; j += L) { \
+		V hin = V_LOAD(hp_ + j), ein = V_LOAD(ep_ + j), M, t, e, f, h, valid; \
+		M = V_ANDNOT(V_CMPEQ(hin, zero), V_SUBS(V_ADDS(hin, V_LOAD(q_ + j)), vbias)); /* M = H(i-1,j-1)? H(i-1,j-1) + S(i,j) : 0 */ \
+		e = V_MAX(V_SUBS(ein, ve_del), V_MAX(V_SUBS(M, voe_del), zero)); \
+		t = V_MAX(V_SUBS(M, voe_ins), zero); \
+		f = V_OR(V_SHL(t, 1), V_LANE0(fc)); /* F(i,j) from the cell to the left, then from further left */ \
+		V_SCAN(f); \
+		h = V_MAX(V_MAX(M, ein), f); \
+		valid = V_CMPGT(V_SET1(end - j < L? end - j : L), vidx); \
+		h = V_AND(h, valid); \
+		vm = V_MAX(vm, h); \
+		V_STORE(hp_ + j, V_BLEND(hin, V_OR(V_SHL(h, 1), V_LANE0(hc)), valid)); \
+		V_STORE(ep_ + j, V_BLEND(ein, e, valid)); \
+		V_STOREA(tmp, h); \
+		hc = tmp[L - 1]; \
+		if (j + L >= end) *hl = tmp[end - 1 - j]; \
+		V_STOREA(tmp, V_MAX(t, V_SUBS(f, ve_ins))); \
+		fc = tmp[L - 1]; \
+	} \
+	hp_[end] = *hl; ep_[end] = 0; \
+	V_STOREA(tmp, vm); \
+	for (j = 0; j < L; ++j) m = m > tmp[j]? m : tmp[j]; \
+	for (j = end - 1; j >= beg && hp_[j + 1] != m; --j); /* the scalar loop keeps the last column reaching the maximum */ \
+	*mj = beg < end? j : -1; \
+	return m;
+
+#define V __m128i
+#define V_ZERO _mm_setzero_si128()
+#define V_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define V_STORE(p, x) _mm_storeu_si128((__m128i*)(p), x)
+#define V_STOREA(p, x) _mm_store_si128((__m128i*)(p), x)
+#define V_AND _mm_and_si128
+#define V_OR _mm_or_si128
+#define V_ANDNOT _mm_andnot_si128
+#define V_BLEND _mm_blendv_epi8
+#define V_LANE0(c) _mm_cvtsi32_si128(c)
+
+#define V_SET1 _mm_set1_epi8
+#define V_MAX _mm_max_epu8
+#define V_ADDS _mm_adds_epu8
+#define V_SUBS _mm_subs_epu8
+#define V_CMPEQ _mm_cmpeq_epi8
+#define V_CMPGT _mm_cmpgt_epi8
+#define V_IDX _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+#define V_SHL(x, n) _mm_slli_si128(x, n)
+#define V_SCAN(f) do { \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 1), ve_ins)); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 2), V_SET1(e_ins * 2 < 255? e_ins * 2 : 255))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 4), V_SET1(e_ins * 4 < 255? e_ins * 4 : 255))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 8), V_SET1(e_ins * 8 < 255? e_ins * 8 : 255))); \
+	} while (0)
+
+__attribute__((target("sse4.1")))
+static int ksw_row_u8_sse41(const void *qrow, void *hp, void *ep, int beg, int end, int h1, int bias, int e_del, int oe_del, int e_ins, int oe_ins, int *mj, int *hl)
+{
+	KSW_ROW_BODY(uint8_t, 16)
+}
+
+#undef V_SET1
+#undef V_MAX
+#undef V_ADDS
+#undef V_SUBS
+#undef V_CMPEQ
+#undef V_CMPGT
+#undef V_IDX
+#undef V_SHL
+#undef V_SCAN
+#define V_SET1 _mm_set1_epi16
+#define V_MAX _mm_max_epi16
+#define V_ADDS _mm_adds_epi16
+#define V_SUBS _mm_subs_epi16
+#define V_CMPEQ _mm_cmpeq_epi16
+#define V_CMPGT _mm_cmpgt_epi16
+#define V_IDX _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7)
+#define V_SHL(x, n) _mm_slli_si128(x, (n) * 2)
+#define V_SCAN(f) do { \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 1), ve_ins)); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 2), V_SET1(e_ins * 2))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 4), V_SET1(e_ins * 4))); \
+	} while (0)
+
+__attribute__((target("sse4.1")))
+static int ksw_row_i16_sse41(const void *qrow, void *hp, void *ep, int beg, int end, int h1, int bias, int e_del, int oe_del, int e_ins, int oe_ins, int *mj, int *hl)
+{
+	KSW_ROW_BODY(int16_t, 8)
+}
+
+#undef V
+#undef V_ZERO
+#undef V_LOAD
+#undef V_STORE
+#undef V_STOREA
+#undef V_AND
+#undef V_OR
+#undef V_ANDNOT
+#undef V_BLEND
+#undef V_LANE0
+#undef V_SET1
+#undef V_MAX
+#undef V_ADDS
+#undef V_SUBS
+#undef V_CMPEQ
+#undef V_CMPGT
+#undef V_IDX
+#undef V_SHL
+#undef V_SCAN
+
+#define V __m256i
+#define V_ZERO _mm256_setzero_si256()
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define V_STORE(p, x) _mm256_storeu_si256((__m256i*)(p), x)
+#define V_STOREA(p, x) _mm256_store_si256((__m256i*)(p), x)
+#define V_AND _mm256_and_si256
+#define V_OR _mm256_or_si256
+#define V_ANDNOT _mm256_andnot_si256
+#define V_BLEND _mm256_blendv_epi8
+#define V_LANE0(c) _mm256_setr_epi32(c, 0, 0, 0, 0, 0, 0, 0)
+
+#define V_SET1 _mm256_set1_epi8
+#define V_MAX _mm256_max_epu8
+#define V_ADDS _mm256_adds_epu8
+#define V_SUBS _mm256_subs_epu8
+#define V_CMPEQ _mm256_cmpeq_epi8
+#define V_CMPGT _mm256_cmpgt_epi8
+#define V_IDX _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31)
+#define V_SHL(x, n) ksw_shl256(x, n)
+#define V_SCAN(f) do { \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 1), ve_ins)); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 2), V_SET1(e_ins * 2 < 255? e_ins * 2 : 255))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 4), V_SET1(e_ins * 4 < 255? e_ins * 4 : 255))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 8), V_SET1(e_ins * 8 < 255? e_ins * 8 : 255))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 16), V_SET1(e_ins * 16 < 255? e_ins * 16 : 255))); \
+	} while (0)
+
+__attribute__((target("avx2")))
+static int ksw_row_u8_avx2(const void *qrow, void *hp, void *ep, int beg, int end, int h1, int bias, int e_del, int oe_del, int e_ins, int oe_ins, int *mj, int *hl)
+{
+	KSW_ROW_BODY(uint8_t, 32)
+}
+
+#undef V_SET1
+#undef V_MAX
+#undef V_ADDS
+#undef V_SUBS
+#undef V_CMPEQ
+#undef V_CMPGT
+#undef V_IDX
+#undef V_SHL
+#undef V_SCAN
+#define V_SET1 _mm256_set1_epi16
+#define V_MAX _mm256_max_epi16
+#define V_ADDS _mm256_adds_epi16
+#define V_SUBS _mm256_subs_epi16
+#define V_CMPEQ _mm256_cmpeq_epi16
+#define V_CMPGT _mm256_cmpgt_epi16
+#define V_IDX _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+#define V_SHL(x, n) ksw_shl256(x, (n) * 2)
+#define V_SCAN(f) do { \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 1), ve_ins)); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 2), V_SET1(e_ins * 2))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 4), V_SET1(e_ins * 4))); \
+		f = V_MAX(f, V_SUBS(V_SHL(f, 8), V_SET1(e_ins * 8))); \
+	} while (0)
+
+__attribute__((target("avx2")))
+static int ksw_row_i16_avx2(const void *qrow, void *hp, void *ep, int beg, int end, int h1, int bias, int e_del, int oe_del, int e_ins, int oe_ins, int *mj, int *hl)
+{
+	KSW_ROW_BODY(int16_t, 16)
+}
+
+#undef V
+#undef V_ZERO
+#undef V_LOAD
+#undef V_STORE
+#undef V_STOREA
+#undef V_AND
+#undef V_OR
+#undef V_ANDNOT
+#undef V_BLEND
+#undef V_LANE0
+#undef V_SET1
+#undef V_MAX
+#undef V_ADDS
+#undef V_SUBS
+#undef V_CMPEQ
+#undef V_CMPGT
+#undef V_IDX
+#undef V_SHL
+#undef V_SCAN
+#undef KSW_ROW_BODY
+
+#define ksw_get(a, j) (wide? ((int16_t*)(a))[j] : ((uint8_t*)(a))[j])
+#define ksw_set(a, j, x) do { if (wide) ((int16_t*)(a))[j] = (x); else ((uint8_t*)(a))[j] = (x); } while (0)
+
+// ksw_extend_core() with the rows computed by row over cells of 1 (bytes, biased profile) or 2 bytes (wide)
+static int ksw_extend_simd(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, ksw_row_f row, int lanes, int wide, int bias, int *_qle, int *_tle, int *_gtle, int *_gscore, int *_max_off, int *_cells)
+{
+	void *qp, *hp, *ep; // query profile, H(i-1,j-1) and E(i,j) as in the eh_t array of the scalar kernel
+	int i, j, k, oe_del = o_del + e_del, oe_ins = o_ins + e_ins, beg, end, max, max_i, max_j, max_ins, max_del, max_ie, gscore, max_off, cells = 0;
+	int ql = qlen + lanes + 1, sz = wide? 2 : 1; // rows are padded for loads past end
+	assert(h0 > 0);
+
+	// allocate memory
+	qp = malloc((size_t)m * ql * sz);
+	hp = calloc(ql, sz);
+	ep = calloc(ql, sz);
+
+	// generate the query profile
+	for (k = i = 0; k < m; ++k) {
+		const int8_t *p = &mat[k * m];
+		for (j = 0; j < qlen; ++j, ++i) ksw_set(qp, i, p[query[rev? qlen - 1 - j : j]] + bias);
+		for (; j < ql; ++j, ++i) ksw_set(qp, i, bias);
+	}
+
+	// fill the first row
+	ksw_set(hp, 0, h0); ksw_set(hp, 1, h0 > oe_ins? h0 - oe_ins : 0);
+	for (j = 2; j <= qlen && ksw_get(hp, j-1) > e_ins; ++j)
+		ksw_set(hp, j, ksw_get(hp, j-1) - e_ins);
+
+	// adjust $w if it is too large
+	k = m * m;
+	for (i = 0, max = 0; i < k; ++i) // get the max score
+		max = max > mat[i]? max : mat[i];
+	max_ins = (int)((double)(qlen * max + end_bonus - o_ins) / e_ins + 1.);
+	max_ins = max_ins > 1? max_ins : 1;
+	w = w < max_ins? w : max_ins;
+	max_del = (int)((double)(qlen * max + end_bonus - o_del) / e_del + 1.);
+	max_del = max_del > 1? max_del : 1;
+	w = w < max_del? w : max_del;
+
+	// DP loop
+	max = h0, max_i = max_j = -1; max_ie = -1, gscore = -1;
+	max_off = 0;
+	beg = 0, end = qlen;
+	for (i = 0; LIKELY(i < tlen); ++i) {
+		int h1, hl, m, mj;
+
+		// apply the band and the constraint (if provided)
+		if (beg < i - w) beg = i - w;
+		if (end > i + w + 1) end = i + w + 1;
+		if (end > qlen) end = qlen;
+		cells += beg < end? end - beg : 0;
+
+		// compute the first column
+		if (beg == 0) {
+			h1 = h0 - (o_del + e_del * (i + 1));
+			if (h1 < 0) h1 = 0;
+		} else h1 = 0;
+		m = row((uint8_t*)qp + (size_t)target[rev? tlen - 1 - i : i] * ql * sz, hp, ep, beg, end, h1, bias, e_del, oe_del, e_ins, oe_ins, &mj, &hl);
+		if ((beg < end? end : beg) == qlen) {
+			max_ie = gscore > hl? max_ie : i;
+			gscore = gscore > hl? gscore : hl;
+		}
+		if (m == 0) break;
+		if (m > max) {
+			max = m, max_i = i, max_j = mj;
+			max_off = max_off > abs(mj - i)? max_off : abs(mj - i);
+			if (max_off >= wide_off && max > wide_sc) { // the caller will retry with a wider band anyway
+				max = KSW_EXT_WIDER;
+				break;
+			}
+		} else if (zdrop > 0) {
+			if (i - max_i > mj - max_j) {
+				if (max - m - ((i - max_i) - (mj - max_j)) * e_del > zdrop) break;
+			} else {
+				if (max - m - ((mj - max_j) - (i - max_i)) * e_ins > zdrop) break;
+			}
+		}
+		// update beg and end for the next round
+		for (j = beg; LIKELY(j < end) && ksw_get(hp, j) == 0 && ksw_get(ep, j) == 0; ++j);
+		beg = j;
+		for (j = end; LIKELY(j >= beg) && ksw_get(hp, j) == 0 && ksw_get(ep, j) == 0; --j);
+		end = j + 2 < qlen? j + 2 : qlen;
+	}
+	free(qp); free(hp); free(ep);
+	if (_qle) *_qle = max_j + 1;
+	if (_tle) *_tle = max_i + 1;
+	if (_gtle) *_gtle = max_ie + 1;
+	if (_gscore) *_gscore = gscore;
+	if (_max_off) *_max_off = max_off;
+	if (_cells) *_cells = cells;
+	return max;
+}
+
+#undef ksw_get
+#undef ksw_set
+
+// Pick the cell width for an extension: bytes while the best score reachable (h0 plus a best match per
+// aligned residue) stays below 255 with the profile bias, 16 bits below 32767, otherwise the scalar kernel
+static inline int ksw_ext_width(int qlen, int tlen, int m, const int8_t *mat, int h0, int *bias)
+{
+	int i, max = 0, min = 0, best;
+	for (i = 0; i < m * m; ++i) {
+		max = max > mat[i]? max : mat[i];
+		min = min < mat[i]? min : mat[i];
+	}
+	best = h0 + (qlen < tlen? qlen : tlen) * max;
+	*bias = -min;
+	if (best + *bias <= 255) return 1;
+	*bias = 0;
+	return best < 32767? 2 : 0;
+}
+
+static int ksw_extend_sse41(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells)
+{
+	int bias, width = ksw_ext_width(qlen, tlen, m, mat, h0, &bias);
+	if (width == 1) return ksw_extend_simd(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, ksw_row_u8_sse41, 16, 0, bias, qle, tle, gtle, gscore, max_off, cells);
+	if (width == 2) return ksw_extend_simd(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, ksw_row_i16_sse41, 8, 1, bias, qle, tle, gtle, gscore, max_off, cells);
+	return ksw_extend_core(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, qle, tle, gtle, gscore, max_off, cells);
+}
+
+static int ksw_extend_avx2(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells)
+{
+	int bias, width = ksw_ext_width(qlen, tlen, m, mat, h0, &bias);
+	if (width == 1) return ksw_extend_simd(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, ksw_row_u8_avx2, 32, 0, bias, qle, tle, gtle, gscore, max_off, cells);
+	if (width == 2) return ksw_extend_simd(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, ksw_row_i16_avx2, 16, 1, bias, qle, tle, gtle, gscore, max_off, cells);
+	return ksw_extend_core(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, qle, tle, gtle, gscore, max_off, cells);
+}
+
+#endif // KSW_EXT_X86
+
+static int ksw_extend_scalar(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells)
+{
+	return ksw_extend_core(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, qle, tle, gtle, gscore, max_off, cells);
+}
+
+typedef int (*ksw_ext_f)(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells);
+
+static int ksw_extend_resolve(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells);
+static ksw_ext_f ksw_ext = ksw_extend_resolve;
+static int ksw_ext_kernel = KSW_EXT_AUTO;
+
+// Kernel picked on first use; every thread resolves to the same function, so the race is benign
+static int ksw_extend_resolve(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells)
+{
+	ksw_extend_select(KSW_EXT_AUTO);
+	return ksw_ext(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, qle, tle, gtle, gscore, max_off, cells);
+}
+
+const char *ksw_extend_name(int kernel)
+{
+	switch (kernel) {
+		case KSW_EXT_SCALAR: return "scalar";
+		case KSW_EXT_SSE41: return "sse4.1";
+		case KSW_EXT_AVX2: return "avx2";
+		default: return "auto";
+	}
+}
+
+int ksw_extend_select(int kernel)
+{
+	int supported = KSW_EXT_SCALAR;
+
+#ifdef KSW_EXT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1")) supported = KSW_EXT_SSE41;
+	if (supported == KSW_EXT_SSE41 && __builtin_cpu_supports("avx2")) supported = KSW_EXT_AVX2;
+#endif
+
+	if (kernel < KSW_EXT_AUTO || kernel > supported) return -1;
+	if (kernel == KSW_EXT_AUTO) kernel = supported;
+
+	switch (kernel) {
+#ifdef KSW_EXT_X86
+		case KSW_EXT_SSE41: ksw_ext = ksw_extend_sse41; break;
+		case KSW_EXT_AVX2: ksw_ext = ksw_extend_avx2; break;
+#endif
+		default: ksw_ext = ksw_extend_scalar; break;
+	}
+
+	return ksw_ext_kernel = kernel;
+}
+
+int ksw_extend2(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int *qle, int *tle, int *gtle, int *gscore, int *max_off)
+{
+	return ksw_ext(qlen, query, tlen, target, 0, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, INT_MAX, INT_MAX, qle, tle, gtle, gscore, max_off, 0);
+}
+
+int ksw_extend2_rev(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int *qle, int *tle, int *gtle, int *gscore, int *max_off)
+{
+	return ksw_ext(qlen, query, tlen, target, 1, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, INT_MAX, INT_MAX, qle, tle, gtle, gscore, max_off, 0);
+}
+
+int ksw_extend2_try(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells)
+{
+	return ksw_ext(qlen, query, tlen, target, rev, m, mat, o_del, e_del, o_ins, e_ins, w, end_bonus, zdrop, h0, wide_off, wide_sc, qle, tle, gtle, gscore, max_off, cells);
+}
+
 int ksw_extend(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int m, const int8_t *mat, int gapo, int gape, int w, int end_bonus, int zdrop, int h0, int *qle, int *tle, int *gtle, int *gscore, int *max_off)
 {
 	return ksw_extend2(qlen, query, tlen, target, m, mat, gapo, gape, gapo, gape, w, end_bonus, zdrop, h0, qle, tle, gtle, gscore, max_off);
@@ -8,6 +8,20 @@
 #define KSW_XSUBO  0x40000
 #define KSW_XSTART 0x80000
 
+// Vector widths of ksw_align2() (see ksw_align_select)
+#define KSW_ALIGN_AUTO   0
+#define KSW_ALIGN_SSE2   1
+#define KSW_ALIGN_AVX2   2
+#define KSW_ALIGN_AVX512 3
+
+// Kernels computing ksw_extend2() (see ksw_extend_select)
+#define KSW_EXT_AUTO   0
+#define KSW_EXT_SCALAR 1
+#define KSW_EXT_SSE41  2
+#define KSW_EXT_AVX2   3
+
+#define KSW_EXT_WIDER  -1 // returned by ksw_extend2_try() when it gives up for a wider band
+
 struct _kswq_t;
 typedef struct _kswq_t kswq_t;
 
@@ -63,6 +77,17 @@ extern "C" {
 	kswr_t ksw_align(int qlen, uint8_t *query, int tlen, uint8_t *target, int m, const int8_t *mat, int gapo, int gape, int xtra, kswq_t **qry);
 	kswr_t ksw_align2(int qlen, uint8_t *query, int tlen, uint8_t *target, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int xtra, kswq_t **qry);
 
+	/**
+	 * Select the vector width of ksw_align2(): SSE2, AVX2 or AVX-512BW, all giving identical results. A query
+	 * profile keeps the width it was built with. KSW_ALIGN_AUTO picks SSE2 or AVX2 by query length, unless
+	 * the environment variable PALADIN_KSW_ALIGN names a width (sse2, avx2 or avx512bw) to use throughout;
+	 * this is also what the first profile picks when none was selected.
+	 *
+	 * @return        kernel in use, or -1 if it is not supported on this CPU
+	 */
+	int ksw_align_select(int kernel);
+	const char *ksw_align_name(int kernel);
+
 	/**
 	 * Banded global alignment
 	 *
@@ -107,6 +132,31 @@ extern "C" {
 	int ksw_extend(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int m, const int8_t *mat, int gapo, int gape, int w, int end_bonus, int zdrop, int h0, int *qle, int *tle, int *gtle, int *gscore, int *max_off);
 	int ksw_extend2(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int *qle, int *tle, int *gtle, int *gscore, int *max_off);
 
+	/**
+	 * Extend leftwards: same as ksw_extend2() on reversed copies of query and target, but reading
+	 * them in place from query[qlen-1] and target[tlen-1] backwards
+	 */
+	int ksw_extend2_rev(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int *qle, int *tle, int *gtle, int *gscore, int *max_off);
+
+	/**
+	 * One try of an extension at increasing bandwidths: ksw_extend2(), or ksw_extend2_rev() with rev set,
+	 * that returns KSW_EXT_WIDER as soon as the best score exceeds wide_sc at wide_off or more off the
+	 * diagonal, i.e. once the caller is bound to retry with a wider band. Pass INT_MAX to never give up.
+	 *
+	 * @param cells   (out) number of DP cells computed
+	 */
+	int ksw_extend2_try(int qlen, const uint8_t *query, int tlen, const uint8_t *target, int rev, int m, const int8_t *mat, int o_del, int e_del, int o_ins, int e_ins, int w, int end_bonus, int zdrop, int h0, int wide_off, int wide_sc, int *qle, int *tle, int *gtle, int *gscore, int *max_off, int *cells);
+
+	/**
+	 * Select the kernel used by ksw_extend2() and ksw_extend2_rev(): the scalar loop, or its rows computed
+	 * in SSE4.1 or AVX2 vectors of bytes or 16-bit cells with identical results. KSW_EXT_AUTO takes the
+	 * widest supported, which is also what the first extension picks when none was selected.
+	 *
+	 * @return        kernel in use, or -1 if it is not supported on this CPU
+	 */
+	int ksw_extend_select(int kernel);
+	const char *ksw_extend_name(int kernel);
+
 #ifdef __cplusplus
 }
 #endif
@@ -85,6 +85,7 @@ int main(int argc, char *argv[]) {
 	else if (strcmp(argv[1], "bwtupdate") == 0) ret = command_bwtupdate(argc-1, argv+1);
 	else if (strcmp(argv[1], "bwt2sa") == 0) ret = command_bwt2sa(argc-1, argv+1);
 	else if (strcmp(argv[1], "shm") == 0) ret = main_shm(argc-1, argv+1);
+	else if (strcmp(argv[1], "bench") == 0) ret = command_bench(argc-1, argv+1);
 	else if (strcmp(argv[1], "version") == 0) return renderVersion();
 	else {
 		fprintf(stderr, "[main] unrecognized command '%s'\n", argv[1]);
@@ -120,7 +121,8 @@ int renderMainUsage() {
 	fprintf(stderr, "         fa2pac        convert FASTA to PAC format\n");
 	fprintf(stderr, "         pac2bwt       generate BWT from PAC\n");
 	fprintf(stderr, "         bwtupdate     update .bwt to the new format\n");
-	fprintf(stderr, "         bwt2sa        generate SA from BWT and Occ\n\n");
+	fprintf(stderr, "         bwt2sa        generate SA from BWT and Occ\n");
+	fprintf(stderr, "         bench         microbenchmark index kernels\n\n");
 	fprintf(stderr, "         version       version and contact information\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr,
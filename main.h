@@ -77,5 +77,6 @@ int renderVersion();
 int bwa_fa2pac(int argc, char *argv[]);
 int main_shm(int argc, char *argv[]);
 int main_pemerge(int argc, char *argv[]);
+int command_bench(int argc, char *argv[]);
 
 #endif /* MAIN_H_ */
@@ -2,15 +2,30 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 #ifdef USE_MALLOC_WRAPPERS
 /* Don't wrap ourselves */
 #  undef USE_MALLOC_WRAPPERS
 #endif
 #include "malloc_wrap.h"
 
+#ifdef PALADIN_ALLOC_STATS
+/* Calls made through the wrappers, summed over all threads; a shared counter, so only in stats builds */
+static uint64_t wrap_n_alloc;
+
+uint64_t wrap_alloc_count(void) {
+	return __atomic_load_n(&wrap_n_alloc, __ATOMIC_RELAXED);
+}
+
+#  define wrap_count() __atomic_fetch_add(&wrap_n_alloc, 1, __ATOMIC_RELAXED)
+#else
+#  define wrap_count()
+#endif
+
 void *wrap_calloc(size_t nmemb, size_t size,
 				  const char *file, unsigned int line, const char *func) {
 	void *p = calloc(nmemb, size);
+	wrap_count();
 	if (NULL == p) {
 		fprintf(stderr,
 				"[%s] Failed to allocate %zd bytes at %s line %u: %s\n",
@@ -23,6 +38,7 @@ void *wrap_calloc(size_t nmemb, size_t size,
 void *wrap_malloc(size_t size,
 				  const char *file, unsigned int line, const char *func) {
 	void *p = malloc(size);
+	wrap_count();
 	if (NULL == p) {
 		fprintf(stderr,
 				"[%s] Failed to allocate %zd bytes at %s line %u: %s\n",
@@ -35,6 +51,7 @@ void *wrap_malloc(size_t size,
 void *wrap_realloc(void *ptr, size_t size,
 				   const char *file, unsigned int line, const char *func) {
 	void *p = realloc(ptr, size);
+	wrap_count();
 	if (NULL == p) {
 		fprintf(stderr,
 				"[%s] Failed to allocate %zd bytes at %s line %u: %s\n",
@@ -47,6 +64,7 @@ void *wrap_realloc(void *ptr, size_t size,
 char *wrap_strdup(const char *s,
 				  const char *file, unsigned int line, const char *func) {
 	char *p = strdup(s);
+	wrap_count();
 	if (NULL == p) {
 		fprintf(stderr,
 				"[%s] Failed to allocate %zd bytes at %s line %u: %s\n",
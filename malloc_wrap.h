@@ -3,6 +3,7 @@
 
 #include <stdlib.h>  /* Avoid breaking the usual definitions */
 #include <string.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,6 +17,10 @@ extern "C" {
 					   const char *file, unsigned int line, const char *func);
 	char *wrap_strdup(const char *s,
 					  const char *file, unsigned int line, const char *func);
+#ifdef PALADIN_ALLOC_STATS
+	/* Number of allocations made through the wrappers so far */
+	uint64_t wrap_alloc_count(void);
+#endif
 
 #ifdef __cplusplus
 }
@@ -14,6 +14,7 @@
 #define ALIGN_FLAG_KEEP_PRO   0x0004
 #define ALIGN_FLAG_ADJUST_ORF 0x0008
 #define ALIGN_FLAG_MANUAL_PRO 0x0010
+#define ALIGN_FLAG_REPORT_ONLY 0x0020
 
 extern unsigned char codon_aa_hash[64];
 
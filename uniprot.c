@@ -121,6 +121,9 @@ int cleanUniprotReference(int passReference, const char * passBase) {
 	// If indexed, also fix protein header
 	if (indexed) {
 		sprintf(tempName, "%s.pro", passBase);
+		// Keep the layout fields of the existing index
+		memset(&newHeader, 0, sizeof(newHeader));
+		if (access(tempName, F_OK) != -1) newHeader = getIndexHeader(tempName);
 		proHandle = err_xopen_core(__func__, tempName, "w");
 
 		newHeader.multiFrame = 1;
@@ -378,11 +381,11 @@ void renderNumberAligned(const mem_opt_t * passOptions) {
 }
 
 int addUniprotList(worker_t * passWorker, int passSize, int passFull) {
-	int entryIdx, alnIdx, addPriIdx, addSecIdx, parseIdx;
+	int entryIdx, alnIdx, addPriIdx, addSecIdx, parseIdx, idLen;
 	int refID, alignType, primaryCount, totalAlign, entryQuality;
 	UniprotList * globalLists;
 	int * globalCount, * currentIdx;
-	char * uniprotEntry;
+	const char * uniprotEntry;
 
 	// Create lists
 	uniprotPriEntryLists = realloc(uniprotPriEntryLists, (uniprotPriListCount + 1) * sizeof(UniprotList));
@@ -448,11 +451,12 @@ int addUniprotList(worker_t * passWorker, int passSize, int passFull) {
 				}
 			}
 
-			uniprotEntry[parseIdx] = 0;	
+			// Names may live in a read-only index mapping, so the ID is bounded by length rather than terminated in place
+			idLen = parseIdx;
 
 			// Full ID and quality
-			globalLists[*globalCount].entries[*currentIdx].id = malloc(strlen(uniprotEntry) + 1);
-			sprintf(globalLists[*globalCount].entries[*currentIdx].id, "%s", uniprotEntry);
+			globalLists[*globalCount].entries[*currentIdx].id = malloc(idLen + 1);
+			sprintf(globalLists[*globalCount].entries[*currentIdx].id, "%.*s", idLen, uniprotEntry);
 			globalLists[*globalCount].entries[*currentIdx].numOccurrence = 1;
 
             entryQuality = passWorker->regs[entryIdx].a[alnIdx].mapq;
@@ -462,12 +466,12 @@ int addUniprotList(worker_t * passWorker, int passSize, int passFull) {
             }
 
 			// Gene/organism
-			for (parseIdx = 0 ; parseIdx < strlen(uniprotEntry) ; parseIdx++) {
+			for (parseIdx = 0 ; parseIdx < idLen ; parseIdx++) {
 				if (*(uniprotEntry + parseIdx) == '_') {
 					globalLists[*globalCount].entries[*currentIdx].gene = malloc(parseIdx + 1);
 					sprintf(globalLists[*globalCount].entries[*currentIdx].gene, "%.*s", parseIdx, uniprotEntry);
-					globalLists[*globalCount].entries[*currentIdx].organism = malloc(strlen(uniprotEntry + parseIdx) + 1);
-					sprintf(globalLists[*globalCount].entries[*currentIdx].organism, "%s", uniprotEntry + parseIdx + 1);
+					globalLists[*globalCount].entries[*currentIdx].organism = malloc(idLen - parseIdx + 1);
+					sprintf(globalLists[*globalCount].entries[*currentIdx].organism, "%.*s", idLen - parseIdx - 1, uniprotEntry + parseIdx + 1);
 					parseIdx = -1;
 					break;
 				}
@@ -475,8 +479,8 @@ int addUniprotList(worker_t * passWorker, int passSize, int passFull) {
 
 			// If underscore missing, we may be dealing with clustered ID with deleted representative
 			if (parseIdx > -1) {
-				globalLists[*globalCount].entries[*currentIdx].gene = malloc(strlen(uniprotEntry) + 1);
-				sprintf(globalLists[*globalCount].entries[*currentIdx].gene, "%s", uniprotEntry);
+				globalLists[*globalCount].entries[*currentIdx].gene = malloc(idLen + 1);
+				sprintf(globalLists[*globalCount].entries[*currentIdx].gene, "%.*s", idLen, uniprotEntry);
 				globalLists[*globalCount].entries[*currentIdx].organism = malloc(8);
 				sprintf(globalLists[*globalCount].entries[*currentIdx].organism, "Unknown");
 			}